@@ -2,69 +2,25 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#endif
 #include "scanner.h"
 #include "error_handler.h"
+#include "scan_skip.h"
+#include "arena.h"
+#include "lexer_tables.h" // generated by gen_lexer_tables at build time
 
 const char *tokenTypeNames[] = {
-    "PLUS",
-    "MINUS",
-    "MUL",
-    "DIV",
-    "MOD",
-    "PPLUS",
-    "MMINUS",
-    "POWER",
-    "LT",
-    "GT",
-    "LTE",
-    "GTE",
-    "EQ",
-    "UNEQ",
-    "AAND",
-    "OR",
-    "OR1",
-    "NOT",
-    "ASSIGN",
-    "PLUS_ASSIGN",
-    "MINUS_ASSIGN",
-    "MUL_ASSIGN",
-    "DIV_ASSIGN",
-    "MOD_ASSIGN",
-    "POWER_ASSIGN",
-    "AND",
-    "LEFT_SHIFT",
-    "RIGHT_SHIFT",
-    "INT",
-    "FRAC",
-    "STR",
-    "VOID",
-    "ID",
-    "INTL",
-    "FRACL",
-    "STRL",
-    "LCUR",
-    "RCUR",
-    "LPAR",
-    "RPAR",
-    "LBRA",
-    "RBRA",
-    "NEWLINE",
-    "COLON",
-    "SEMI",
-    "COMMA",
-    "INDENT",
-    "COMMENT",
-    "DO",
-    "WHILE",
-    "FOR",
-    "DEF",
-    "RETURN",
-    "IN",
-    "IF",
-    "ELIF",
-    "ELSE",
-    "ERROR",
-    "END_OF_FILE"};
+#define TOKEN_NAME(name, spelling) #name,
+    TOKEN_LIST(TOKEN_NAME)
+#undef TOKEN_NAME
+};
 void handleError(ErrorCode code, const char *details)
 {
     switch (code)
@@ -90,475 +46,1693 @@ void handleError(ErrorCode code, const char *details)
     // 根据需要决定是否退出程序
     exit(EXIT_FAILURE);
 }
+#define LIST_BLOCK_SIZE (64 * 1024) // ordinary arena block of a token list
+
 void initList(List *list)
 {
-    list->head = NULL;
-    list->tail = NULL;
+    arenaInit(&list->arena, LIST_BLOCK_SIZE);
+    list->type = NULL;
+    list->offset = NULL;
+    list->lineStart = NULL;
+    list->lineCount = 0;
+    list->lineCapacity = 0;
+    list->length = NULL;
+    list->aux = NULL;
+    list->triviaEnd = NULL;
+    list->triviaType = NULL;
+    list->triviaOffset = NULL;
+    list->triviaLength = NULL;
+    list->triviaCount = 0;
+    list->triviaCapacity = 0;
+    list->literal = NULL;
+    list->literalCount = 0;
+    list->literalCapacity = 0;
+    list->diag = NULL;
+    list->diagCount = 0;
+    list->diagCapacity = 0;
+    list->info = NULL;
     list->size = 0;
+    list->capacity = 0;
+    list->text = NULL;
+    list->textLen = 0;
+    list->textCap = 0;
+    list->textOwner = TEXT_BORROWED;
+}
+
+/* growArray()
+   A copy of the first used elements of array in a new block of capacity
+   elements from the list's arena. The old block is left to the arena. */
+static void *growArray(List *list, void *array, size_t elemSize, int used, int capacity)
+{
+    void *bigger = arenaAlloc(&list->arena, (size_t)capacity * elemSize);
+    if (used > 0)
+        memcpy(bigger, array, (size_t)used * elemSize);
+    return bigger;
+}
+
+/* reserveTokens()
+   Make room for at least capacity tokens in every array of the list. */
+void reserveTokens(List *list, int capacity)
+{
+    if (capacity <= list->capacity)
+        return;
+    list->type = (unsigned char *)growArray(list, list->type, sizeof(unsigned char), list->size, capacity);
+    list->offset = (unsigned *)growArray(list, list->offset, sizeof(unsigned), list->size, capacity);
+    list->length = (unsigned *)growArray(list, list->length, sizeof(unsigned), list->size, capacity);
+    list->aux = (unsigned *)growArray(list, list->aux, sizeof(unsigned), list->size, capacity);
+    list->triviaEnd = (unsigned *)growArray(list, list->triviaEnd, sizeof(unsigned), list->size, capacity);
+    if (list->info)
+    {
+        char **info = (char **)growArray(list, list->info, sizeof(char *), list->size, capacity);
+        memset(info + list->size, 0, (capacity - list->size) * sizeof(char *));
+        list->info = info;
+    }
+    list->capacity = capacity;
 }
 
-void addToken(List *list, TokenType type, const char *info)
+/* addDiagnostic()
+   Record an error found at offset in the list's text. */
+static void addDiagnostic(List *list, ErrorCode code, size_t offset, const char *message)
 {
-    Node *newNode = (Node *)malloc(sizeof(Node));
-    if (newNode == NULL)
+    if (list->diagCount == list->diagCapacity)
     {
-        handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to allocate memory for new Node in addToken.");
+        int capacity = list->diagCapacity ? list->diagCapacity * 2 : 8;
+        list->diag = (Diagnostic *)growArray(list, list->diag, sizeof(Diagnostic), list->diagCount, capacity);
+        list->diagCapacity = capacity;
+    }
+    Diagnostic *d = &list->diag[list->diagCount++];
+    d->code = code;
+    d->offset = (unsigned)offset;
+    d->lineNum = 0;
+    d->message = message;
+}
+
+/* addLiteral()
+   Work out the value of the INTL or FRACL just pushed, keep it in the
+   literal table and point aux at it. A value that does not fit is
+   recorded as an error and taken as 0. */
+static void addLiteral(List *list, size_t offset, size_t length)
+{
+    if (list->literalCount == list->literalCapacity)
+    {
+        int capacity = list->literalCapacity ? list->literalCapacity * 2 : 64;
+        list->literal = (Rational *)growArray(list, list->literal, sizeof(Rational), list->literalCount, capacity);
+        list->literalCapacity = capacity;
+    }
+    int k = list->literalCount++;
+    const char *error = parseLiteral(list->text + offset, length, &list->literal[k]);
+    if (error != NULL)
+        addDiagnostic(list, ERR_BAD_LITERAL, offset, error);
+    list->aux[list->size - 1] = (unsigned)k;
+}
+
+/* pushToken()
+   Append a token for the slice [offset, offset + length) of list->text, with aux empty. */
+static void pushToken(List *list, TokenType type, size_t offset, size_t length)
+{
+    if (list->size == list->capacity)
+        reserveTokens(list, list->capacity ? list->capacity * 2 : 256);
+
+    int i = list->size++;
+    list->type[i] = (unsigned char)type;
+    list->offset[i] = (unsigned)offset;
+    list->length[i] = (unsigned)length;
+    list->aux[i] = NO_SYMBOL;
+    list->triviaEnd[i] = (unsigned)list->triviaCount;
+}
+
+/* addToken()
+   Append a token whose lexeme is the slice [offset, offset + length) of
+   list->text. Nothing is copied here (see tokenInfo()), except that an ID
+   is interned and its handle kept in aux, and the value of a number is
+   worked out (see addLiteral()). */
+void addToken(List *list, TokenType type, size_t offset, size_t length)
+{
+    pushToken(list, type, offset, length);
+    if (type == ID)
+        list->aux[list->size - 1] = internName(list->text + offset, length);
+    else if (type == INTL || type == FRACL)
+        addLiteral(list, offset, length);
+}
+
+/* addTrivia()
+   Append a comment, line end or raw indentation to the side table; it
+   belongs in front of the next token added. */
+static void reserveTrivia(List *list, int capacity)
+{
+    if (capacity <= list->triviaCapacity)
         return;
+    int used = list->triviaCount;
+    list->triviaType = (unsigned char *)growArray(list, list->triviaType, sizeof(unsigned char), used, capacity);
+    list->triviaOffset = (unsigned *)growArray(list, list->triviaOffset, sizeof(unsigned), used, capacity);
+    list->triviaLength = (unsigned *)growArray(list, list->triviaLength, sizeof(unsigned), used, capacity);
+    list->triviaCapacity = capacity;
+}
+
+static void addTrivia(List *list, TokenType type, size_t offset, size_t length)
+{
+    if (list->triviaCount == list->triviaCapacity)
+        reserveTrivia(list, list->triviaCapacity ? list->triviaCapacity * 2 : 256);
+    int k = list->triviaCount++;
+    list->triviaType[k] = (unsigned char)type;
+    list->triviaOffset[k] = (unsigned)offset;
+    list->triviaLength[k] = (unsigned)length;
+}
+
+/* indentWidth()
+   Width of a run of indentation: a space counts 1 and a tab 4. */
+static int indentWidth(const char *s, size_t n)
+{
+    int width = 0;
+    for (size_t k = 0; k < n; k++)
+        width += (s[k] == '\t') ? 4 : 1;
+    return width;
+}
+
+/* tokenInfo()
+   Returns the lexeme of token index as a '\0' terminated string, copying it
+   into the list's arena the first time it is asked for. Returns NULL for tokens that carry
+   no lexeme (operators, punctuation, keywords, DEDENT). An INDENT token gives its width.
+   An ID gives its spelling in the identifier pool, which outlives the list. */
+const char *tokenInfo(List *list, int index)
+{
+    if (index < 0 || index >= list->size)
+        return NULL;
+    TokenType type = (TokenType)list->type[index];
+    if (!(type == ID || type == INTL || type == FRACL || type == STRL || type == COMMENT || type == INDENT || type == ERROR))
+        return NULL;
+    if (type == ID)
+        return symbolName(list->aux[index]);
+    if (list->info == NULL)
+    {
+        list->info = (char **)arenaAlloc(&list->arena, list->capacity * sizeof(char *));
+        memset(list->info, 0, list->capacity * sizeof(char *));
     }
+    if (list->info[index] != NULL)
+        return list->info[index];
 
-    newNode->type = type;
-    if (type == ID || type == INTL || type == FRACL || type == STRL || type == COMMENT || type == INDENT)
-        newNode->info = strdup(info); // 复制字符串以确保其独立存储
+    if (type == INDENT)
+    {
+        char indentInfo[12];
+        int n = snprintf(indentInfo, sizeof(indentInfo), "%u", list->aux[index]);
+        list->info[index] = arenaStrndup(&list->arena, indentInfo, n);
+    }
     else
-        newNode->info = NULL;
+        list->info[index] = arenaStrndup(&list->arena, list->text + list->offset[index], list->length[index]);
+    return list->info[index];
+}
 
-    // 初始化新节点的指针
-    newNode->next = NULL;
-    newNode->prev = NULL;
+/* tokenSymbol()
+   The interned handle of an ID token; NO_SYMBOL for every other token. */
+Symbol tokenSymbol(List *list, int index)
+{
+    if (index < 0 || index >= list->size || list->type[index] != ID)
+        return NO_SYMBOL;
+    return list->aux[index];
+}
 
-    if (list->head == NULL)
+/* tokenIndentWidth()
+   The indentation width in effect after an INDENT or DEDENT; 0 for every
+   other token. */
+int tokenIndentWidth(List *list, int index)
+{
+    if (index < 0 || index >= list->size)
+        return 0;
+    if (list->type[index] != INDENT && list->type[index] != DEDENT)
+        return 0;
+    return (int)list->aux[index];
+}
+
+/* tokenValue()
+   The exact value of an INTL or FRACL token; 0 / 1 for every other token. */
+Rational tokenValue(List *list, int index)
+{
+    Rational zero = {0, 1};
+    if (index < 0 || index >= list->size)
+        return zero;
+    if (list->type[index] != INTL && list->type[index] != FRACL)
+        return zero;
+    return list->literal[list->aux[index]];
+}
+
+/* triviaBefore()
+   The trivia between token index and the token before it: returns how many
+   there are, and *first the side table index of the first one. */
+int triviaBefore(List *list, int index, int *first)
+{
+    *first = 0;
+    if (index < 0 || index >= list->size)
+        return 0;
+    *first = index > 0 ? (int)list->triviaEnd[index - 1] : 0;
+    return (int)list->triviaEnd[index] - *first;
+}
+
+/* tokenStartsLine()
+   Whether token index is the first token on its line: the first token of
+   all, or one with a line end among the trivia before it. */
+int tokenStartsLine(List *list, int index)
+{
+    int first;
+    int n = triviaBefore(list, index, &first);
+    if (index == 0)
+        return 1;
+    for (int k = first + n - 1; k >= first; k--)
     {
-        list->tail = newNode;
-        list->head = newNode;
-    } // 如果链表为空，则新节点是链表的第一个节点
-    else
-    { // 否则将其添加到链表末尾
-        list->tail->next = newNode;
-        newNode->prev = list->tail;
-        list->tail = newNode;
+        if (list->triviaType[k] == NEWLINE)
+            return 1;
     }
-    list->size++;
+    return 0;
 }
 
-void tokenizeFile(List *list, FILE *file)
+/* tokenLineWidth()
+   The indentation width of the line token index is on, as the off-side
+   rule counts it: the raw indentation after the last line end before the
+   token, or 0 when the line has none. Comments do not count. */
+int tokenLineWidth(List *list, int index)
 {
-    int ch;
-    char buffer[200];
-    int i = 0;
-    int indentLevel = 0;
-    int isStartOfLine = 1; // 用于检测行首
+    int first;
+    int n = triviaBefore(list, index, &first);
+    for (int k = first + n - 1; k >= first; k--)
+    {
+        if (list->triviaType[k] == NEWLINE)
+            break;
+        if (list->triviaType[k] == INDENT)
+            return indentWidth(list->text + list->triviaOffset[k], list->triviaLength[k]);
+    }
+    return 0;
+}
 
-    while ((ch = fgetc(file)) != EOF)
+/* writeSource()
+   Write the text back from the tokens and the trivia, in order, with the
+   blanks between them. The output is the scanned text byte for byte. */
+void writeSource(List *list, FILE *out)
+{
+    size_t done = 0; // text written so far
+    for (int i = 0; i < list->size; i++)
     {
-        if (isStartOfLine)
+        int first;
+        int n = triviaBefore(list, i, &first);
+        for (int k = first; k < first + n; k++)
         {
-            // 行首开始计数缩进
-            indentLevel = 0;
-            while (ch == ' ' || ch == '\t') // 统计空格或tab作为缩进
-            {
-                if (ch == ' ')
-                    indentLevel += 1; // 假设一个空格是一个缩进单位
-                else if (ch == '\t')
-                    indentLevel += 4; // 假设一个tab等于四个空格
-                ch = fgetc(file);
-            }
-            if (indentLevel > 0)
-            {
-                // 将缩进添加为一个新的 token
-                char indentInfo[10];
-                snprintf(indentInfo, sizeof(indentInfo), "%d", indentLevel);
-                addToken(list, INDENT, indentInfo);
-            }
-            isStartOfLine = 0; // 一旦行首处理完毕，取消标记
+            size_t at = list->triviaOffset[k];
+            fwrite(list->text + done, 1, at - done, out); // blanks
+            fwrite(list->text + at, 1, list->triviaLength[k], out);
+            done = at + list->triviaLength[k];
         }
-        if (ch == '#')
+        size_t at = list->offset[i];
+        fwrite(list->text + done, 1, at - done, out);
+        fwrite(list->text + at, 1, list->length[i], out);
+        done = at + list->length[i];
+    }
+    fwrite(list->text + done, 1, list->textLen - done, out);
+}
+
+/* buildLineIndex()
+   lineStart[k] is the offset at which line k + 1 begins. Built the first
+   time a position is asked for: one vectorized pass to count the lines,
+   one to find where they start. */
+static void buildLineIndex(List *list)
+{
+    const char *p = list->text;
+    const char *end = list->text + list->textLen;
+    size_t lines = countNewlines(p, end) + 1;
+    list->lineStart = (unsigned *)arenaAlloc(&list->arena, lines * sizeof(unsigned));
+    list->lineCapacity = (int)lines;
+    list->lineStart[0] = 0;
+    int k = 1;
+    while ((p = skipToEither(p, end, '\n', '\n')) < end)
+        list->lineStart[k++] = (unsigned)(++p - list->text);
+    list->lineCount = k;
+}
+
+/* offsetLineNum()
+   The line (from 1) that holds the byte at offset, by binary search of the
+   line index. A '\n' belongs to the line it ends. */
+int offsetLineNum(List *list, size_t offset)
+{
+    if (list->lineStart == NULL)
+        buildLineIndex(list);
+    int lo = 0, hi = list->lineCount - 1; // lineStart[lo] <= offset always holds
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (list->lineStart[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo + 1;
+}
+
+/* tokenLineNum(), tokenColumn()
+   Line and byte column (both from 1) where token index begins. */
+int tokenLineNum(List *list, int index)
+{
+    if (index < 0 || index >= list->size)
+        return 0;
+    return offsetLineNum(list, list->offset[index]);
+}
+
+int tokenColumn(List *list, int index)
+{
+    if (index < 0 || index >= list->size)
+        return 0;
+    int line = tokenLineNum(list, index);
+    return (int)(list->offset[index] - list->lineStart[line - 1]) + 1;
+}
+
+/* keywordType()
+   Keyword or ID for the identifier [s, s + n): one probe of the perfect hash
+   generated into lexer_tables.h, then one length check and one memcmp. */
+TokenType keywordType(const char *s, size_t n)
+{
+    if (n < KW_MIN_LENGTH || n > KW_MAX_LENGTH)
+        return ID;
+    unsigned h = KW_HASH(s, n);
+    if (kwTable[h].length == n && memcmp(kwTable[h].text, s, n) == 0)
+        return (TokenType)kwTable[h].type;
+    return ID;
+}
+
+/* runDfa()
+   Maximal munch from p: follow the DFA while it has transitions and return
+   the last accepting state passed, or -1 if none. *tokenEnd is set to the
+   end of the accepted text; *ranOut tells whether the DFA was still alive
+   when it reached end, i.e. more input could have made the token longer. */
+static int runDfa(const char *p, const char *end, const char **tokenEnd, int *ranOut)
+{
+    int state = LEX_START;
+    int accepted = -1;
+    *tokenEnd = p;
+    *ranOut = 1;
+    while (p < end)
+    {
+        state = lexNext[state][lexCharClass[(unsigned char)*p]];
+        if (state == LEX_DEAD)
         {
-            ;
-            while ((ch = fgetc(file)) != '\n')
-            {
-                if (ch == EOF)
-                    break;
-            }
-            addToken(list, COMMENT, NULL);
-            if (ch == '\n')
-            {
-                addToken(list, NEWLINE, NULL);
-                isStartOfLine = 1;
-            }
-            continue;
+            *ranOut = 0;
+            break;
         }
-        if (ch == '/')
+        p++;
+        if (lexAccept[state] >= 0)
         {
-            int next_ch = fgetc(file);
-            if (next_ch == '/')
-            {
-                while ((ch = fgetc(file)) != '\n' && ch != EOF)
-                    ;
-                addToken(list, COMMENT, NULL);
-                if (ch == '\n')
-                {
-                    addToken(list, NEWLINE, NULL);
-                    isStartOfLine = 1;
-                }
-                continue;
-            }
-            else if (next_ch == '*')
-            {
-                while (1)
-                {
-                    while ((ch = fgetc(file)) != '*' && ch != EOF)
-                        ;
-                    if ((ch = fgetc(file)) == '/')
-                    {
-                        addToken(list, COMMENT, NULL);
-                        break;
-                    }
-                    if (ch == EOF)
-                        break;
-                }
-                continue;
-            }
-            else
-            {
-                ungetc(next_ch, file); // 将读取的字符放回文件流
-            }
+            accepted = lexAccept[state];
+            *tokenEnd = p;
         }
-        else if (ch == '"')
+    }
+    return accepted;
+}
+
+/* lexError()
+   An ERROR token from start to the end of its line, after which scanning
+   goes on with the next line. The message is left in pos for the caller
+   to record. */
+static const char *lexError(LexPos *pos, const char *start, const char *end, ErrorCode code, const char *message, TokenType *type)
+{
+    pos->errorCode = code;
+    pos->error = message;
+    *type = ERROR;
+    return skipToEither(start, end, '\n', '\n');
+}
+
+/* lexToken()
+   Recognise the token that starts at p, in [p, end). Layout (indentation,
+   line ends, blanks) is handled here; every other token is recognised by the
+   table-driven DFA with maximal munch, so "x=x+1;" is five tokens and "**="
+   is one. Returns the end of the text consumed, with *type and *line set to
+   the token's type and first line; *type is TOKEN_COUNT when only blanks
+   were consumed. When the input may continue past end (atEof is 0) and the
+   token could too, returns NULL and leaves pos unchanged: the caller reads
+   more and calls again from the same p. Text that is not a token (an
+   unknown character, a string literal that runs into the end of the input)
+   gives an ERROR up to the end of the line, with pos->error set. Lines inside comments and
+   string literals are only counted when pos->trackLines is set; a token
+   list finds its lines afterwards from the line index instead. */
+static const char *lexToken(LexPos *pos, const char *p, const char *end, int atEof, TokenType *type, int *line)
+{
+    const char *start = p;
+    *line = pos->lineNum;
+    if (pos->isStartOfLine)
+    {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p == end && !atEof)
+            return NULL;
+        *type = p > start ? INDENT : TOKEN_COUNT;
+        pos->isStartOfLine = 0;
+        return p;
+    }
+    if (*p == '\n')
+    {
+        *type = NEWLINE;
+        pos->lineNum++;
+        pos->isStartOfLine = 1;
+        return p + 1;
+    }
+    if (isspace((unsigned char)*p))
+    {
+        *type = TOKEN_COUNT; // blanks can be dropped in pieces
+        return skipBlanks(p + 1, end);
+    }
+
+    const char *tokenEnd;
+    int ranOut;
+    int accepted = runDfa(p, end, &tokenEnd, &ranOut);
+    if (ranOut && !atEof)
+        return NULL;
+    if (accepted < 0)
+    {
+        const char *lineEnd = skipToEither(p, end, '\n', '\n');
+        if (lineEnd == end && !atEof)
+            return NULL;
+        return lexError(pos, p, end, ERR_UNKNOWN_TOKEN, "Unknown character.", type);
+    }
+    p = tokenEnd;
+    switch (accepted)
+    {
+    case LEX_LINE_COMMENT:
+        p = skipToEither(p, end, '\n', '\n');
+        if (p == end && !atEof)
+            return NULL;
+        *type = COMMENT;
+        return p; // the '\n' is an ordinary line end
+    case LEX_BLOCK_COMMENT:
+    {
+        int lines = 0;
+        char newline = pos->trackLines ? '\n' : '*'; // only stop at line ends when counting them
+        while ((p = skipToEither(p, end, '*', newline)) < end)
         {
-            {
-                i = 0;
-                buffer[i] = ch;
-                i++;
-                while ((ch = fgetc(file)) != '"' && ch != EOF)
-                {
-                    buffer[i] = ch;
-                    i++;
-                }
-                if (ch == EOF)
-                {
-                    handleError(ERR_UNKNOWN_TOKEN, "Unexpected end of file while reading string literal.");
-                    return;
-                }
-                buffer[i] = ch;
-                i++;
-                buffer[i] = '\0';
-                addToken(list, STRL, buffer);
-                fgetc(file);
-                continue;
-            }
+            if (*p == '\n')
+                lines++;
+            else if (p + 1 == end && !atEof)
+                return NULL;
+            else if (p + 1 < end && p[1] == '/')
+                break;
+            p++;
         }
-        else if (!isspace(ch))
+        if (p == end && !atEof)
+            return NULL;
+        pos->lineNum += lines;
+        *type = COMMENT;
+        return (p < end) ? p + 2 : end;
+    }
+    case LEX_STRING:
+    {
+        int lines = 0;
+        char newline = pos->trackLines ? '\n' : '"';
+        while ((p = skipToEither(p, end, '"', newline)) < end && *p == '\n')
         {
-            if (i < sizeof(buffer) - 1) // 确保不会缓冲区溢出
-            {
-                buffer[i] = ch;
-                i++;
-            }
+            lines++;
+            p++;
         }
-        else if (i > 0)
+        if (p == end)
         {
-            buffer[i] = '\0';
-            addToken(list, identifyTokenType(buffer), buffer);
-            i = 0;
-            if (ch == '\n')
-            {
-                addToken(list, NEWLINE, NULL);
-                isStartOfLine = 1; // 新行开始，重置标记
-            }
+            if (!atEof)
+                return NULL;
+            return lexError(pos, start, end, ERR_UNTERMINATED_STRING, "Unexpected end of file while reading string literal.", type);
         }
+        pos->lineNum += lines;
+        *type = STRL;
+        return p + 1; // closing quote
+    }
+    case ID:
+        *type = keywordType(start, p - start);
+        return p;
+    default:
+        *type = (TokenType)accepted;
+        return p;
     }
+}
+
+/* initLayout()
+   The top level: one base level of width 0, at the start of a line. */
+void initLayout(Layout *layout)
+{
+    layout->stack[0].width = 0;
+    layout->stack[0].isBase = 1;
+    layout->depth = 1;
+    layout->parens = 0;
+    layout->atLineStart = 1;
+    layout->lineWidth = 0;
+    layout->dedentTo = -1;
+    layout->closeFrame = 0;
+    layout->openFrame = 0;
+    layout->closeAll = 0;
+    layout->tooDeep = 0;
+}
 
-    if (i > 0)
+/* pushLevel()
+   Returns 0, with tooDeep set, when the stack is full: the line then stays
+   on the level it is on. */
+static int pushLevel(Layout *layout, int width, int isBase)
+{
+    if (layout->depth == LAYOUT_MAX_DEPTH)
     {
-        buffer[i] = '\0';
-        addToken(list, identifyTokenType(buffer), buffer);
+        layout->tooDeep = 1;
+        return 0;
     }
-    addToken(list, END_OF_FILE, NULL);
+    layout->stack[layout->depth].width = width;
+    layout->stack[layout->depth].isBase = isBase;
+    layout->depth++;
+    return 1;
 }
-TokenType identifyTokenType(const char *token)
+
+/* layoutHold()
+   Show the off-side rule the next scanned token. Returns 0 if the token is
+   raw indentation, which is absorbed. Otherwise the token is held: the
+   caller takes the INDENT/DEDENTs due before it from layoutNext() and then
+   emits it. width is the width of raw indentation. */
+static int layoutHold(Layout *layout, TokenType type, int width)
 {
-    switch (token[0])
+    switch (type)
     {
-    case '#':
-        return COMMENT;
-        break;
-    case '{':
-        return LCUR;
-        break;
-    case '}':
-        return RCUR;
-        break;
-    case '(':
-        return LPAR;
-        break;
-    case ')':
-        return RPAR;
-        break;
-    case '[':
-        return LBRA;
-        break;
-    case ']':
-        return RBRA;
-        break;
-    case '\n':
-        return NEWLINE;
-        break;
-    case ':':
-        return COLON;
-        break;
-    case ';':
-        return SEMI;
-        break;
-    case ',':
-        return COMMA;
-        break; // single character tokens
-    case '+':
-        if (token[1] == '\0')
-            return PLUS;
-        if (token[1] == '+')
-            return PPLUS;
-        if (token[1] == '=')
-            return PLUS_ASSIGN;
-        break;
-    case '-':
-        if (token[1] == '\0')
-            return MINUS;
-        if (token[1] == '-')
-            return MMINUS;
-        if (token[1] == '=')
-            return MINUS_ASSIGN;
-        break;
-    case '*':
-        if (token[1] == '\0')
-            return MUL;
-        if (token[1] == '*')
-            return POWER;
-        if (token[1] == '=')
-            return MUL_ASSIGN;
-        break;
-    case '/':
-        if (token[1] == '\0')
-            return DIV;
-        if (token[1] == '=')
-            return DIV_ASSIGN;
-        if (token[1] == '/')
-            return COMMENT;
-        if (token[1] == '*')
-            return COMMENT; // comment
-        break;
-    case '%':
-        if (token[1] == '\0')
-            return MOD;
-        if (token[1] == '=')
-            return MOD_ASSIGN;
-        break;
-    case '<':
-        if (token[1] == '\0')
-            return LT;
-        if (token[1] == '=')
-            return LTE;
-        if (token[1] == '<')
-            return LEFT_SHIFT;
-        break;
-    case '>':
-        if (token[1] == '\0')
-            return GT;
-        if (token[1] == '=')
-            return GTE;
-        if (token[1] == '>')
-            return RIGHT_SHIFT;
+    case INDENT:
+        layout->lineWidth = width;
+        return 0;
+    case NEWLINE:
+        layout->atLineStart = 1;
+        layout->lineWidth = 0;
+        return 1;
+    case COMMENT:
+        return 1;
+    case END_OF_FILE:
+        layout->closeAll = 1;
+        return 1;
+    default:
         break;
-    case '=':
-        if (token[1] == '\0')
-            return ASSIGN;
-        if (token[1] == '=')
-            return EQ;
+    }
+
+    if (layout->atLineStart)
+    {
+        layout->atLineStart = 0;
+        IndentLevel *top = &layout->stack[layout->depth - 1];
+        if (layout->parens > 0)
+            ; // a continuation line
+        else if (top->width < 0)
+            top->width = layout->lineWidth; // first line of a frame sets its base
+        else
+            layout->dedentTo = layout->lineWidth;
+    }
+    switch (type)
+    {
+    case LPAR:
+    case LBRA:
+        layout->parens++;
         break;
-    case '!':
-        if (token[1] == '\0')
-            return NOT;
-        if (token[1] == '=')
-            return UNEQ;
+    case RPAR:
+    case RBRA:
+        if (layout->parens > 0)
+            layout->parens--;
         break;
-    case '&':
-        if (token[1] == '&')
-            return AAND;
-        if (token[1] == '\0')
-            return AND;
+    case LCUR:
+        layout->openFrame = 1;
         break;
-    case '|':
-        if (token[1] == '|')
-            return OR;
-        if (token[1] == '\0')
-            return OR1;
+    case RCUR:
+        layout->closeFrame = 1;
         break;
     default:
         break;
     }
+    return 1;
+}
+
+/* layoutNext()
+   The next INDENT or DEDENT due before the held token, with *width the
+   indentation in effect after it; TOKEN_COUNT when the held token is next.
+   A line may dedent to a width between two levels: it then pops to the
+   shallower one and pushes its own, with an INDENT. A line indented less
+   than its frame's base closes nothing. */
+static TokenType layoutNext(Layout *layout, int *width)
+{
+    IndentLevel *top = &layout->stack[layout->depth - 1];
+    if (layout->dedentTo >= 0)
+    {
+        if (!top->isBase && top->width > layout->dedentTo)
+        {
+            layout->depth--;
+            *width = layout->stack[layout->depth - 1].width;
+            return DEDENT;
+        }
+        int target = layout->dedentTo;
+        layout->dedentTo = -1;
+        if (top->width < target && pushLevel(layout, target, 0))
+        {
+            *width = target;
+            return INDENT;
+        }
+    }
+    if (layout->closeFrame || layout->closeAll)
+    {
+        if (!top->isBase)
+        {
+            layout->depth--;
+            *width = layout->stack[layout->depth - 1].width;
+            return DEDENT;
+        }
+        if (layout->depth > 1)
+        {
+            layout->depth--; // the frame base itself; no token
+            if (layout->closeAll)
+                return layoutNext(layout, width);
+        }
+        layout->closeFrame = 0;
+        layout->closeAll = 0;
+    }
+    if (layout->openFrame)
+    {
+        pushLevel(layout, -1, 1);
+        layout->openFrame = 0;
+    }
+    return TOKEN_COUNT;
+}
+
+/* addLayoutToken()
+   addToken() through the off-side rule. Raw indentation, comments and line
+   ends go to the trivia table. The INDENT/DEDENTs due before a token are
+   added in front of it, empty, where the token starts, with their width in
+   aux. */
+static void addLayoutToken(List *list, Layout *layout, TokenType type, size_t offset, size_t length)
+{
+    int width = type == INDENT ? indentWidth(list->text + offset, length) : 0;
+    if (!layoutHold(layout, type, width) || type == COMMENT || type == NEWLINE)
+    {
+        addTrivia(list, type, offset, length);
+        return;
+    }
+    TokenType layoutType;
+    while ((layoutType = layoutNext(layout, &width)) != TOKEN_COUNT)
+    {
+        addToken(list, layoutType, offset, 0);
+        list->aux[list->size - 1] = (unsigned)width;
+    }
+    if (layout->tooDeep)
+    {
+        addDiagnostic(list, ERR_INDENTATION, offset, "Too many levels of indentation.");
+        layout->tooDeep = 0;
+    }
+    addToken(list, type, offset, length);
+}
+
+/* scanText()
+   Scan all of list->text through layout, as from the start of the input.
+   No END_OF_FILE is added. */
+static void scanText(List *list, Layout *layout)
+{
+    const char *data = list->text;
+    const char *p = data;
+    const char *end = data + list->textLen;
+    LexPos pos = {1, 1, ERR_UNKNOWN_TOKEN, NULL, 0};
+    while (p < end)
+    {
+        TokenType type;
+        int line;
+        const char *next = lexToken(&pos, p, end, 1, &type, &line);
+        if (type == ERROR)
+            addDiagnostic(list, pos.errorCode, p - data, pos.error);
+        if (type != TOKEN_COUNT)
+            addLayoutToken(list, layout, type, p - data, next - p);
+        p = next;
+    }
+}
+
+/* tokenizeFile()
+   The stream path, for pipes and other inputs that cannot be mapped: read the
+   whole stream into list->text with large reads, then scan it as a buffer.
+   If the stream fails, or its text does not fit in memory, nothing is
+   scanned: the list stays empty and the result is SCAN_FAILED. */
+ScanStatus tokenizeFile(List *list, FILE *file)
+{
+    size_t cap = 64 * 1024;
+    size_t len = 0;
+    char *text = (char *)malloc(cap);
+    if (text == NULL)
+        return SCAN_FAILED;
+    size_t n;
+    while ((n = fread(text + len, 1, cap - len, file)) > 0)
+    {
+        len += n;
+        if (len == cap)
+        {
+            char *bigger = (char *)realloc(text, cap * 2);
+            if (bigger == NULL)
+            {
+                free(text);
+                return SCAN_FAILED;
+            }
+            text = bigger;
+            cap *= 2;
+        }
+    }
+    if (ferror(file)) // fread() stops the same way at an I/O error as at the end
+    {
+        free(text);
+        return SCAN_FAILED;
+    }
+    ScanStatus status = tokenizeBuffer(list, text, len);
+    list->textCap = cap;
+    list->textOwner = TEXT_OWNED;
+    return status;
+}
+
+/* tokenizeBuffer()
+   Scan the whole input [data, data + len) in one pass with lexToken(),
+   laying the tokens out with the off-side rule and putting the trivia in
+   the side table. data does not need to be '\0' terminated. Tokens point
+   into data, which must stay alive as long as the list; the list does not
+   own it. Errors in the text are recorded in the list, not fatal. */
+ScanStatus tokenizeBuffer(List *list, const char *data, size_t len)
+{
+    Layout layout;
+    initLayout(&layout);
+
+    list->text = (char *)data;
+    list->textLen = len;
+    list->textCap = 0;
+    list->textOwner = TEXT_BORROWED;
+    reserveTokens(list, (int)(len / 4) + 16); // 大约每4个字节一个token
+
+    scanText(list, &layout);
+    addLayoutToken(list, &layout, END_OF_FILE, len, 0);
+    return list->diagCount ? SCAN_ERRORS : SCAN_OK;
+}
+
+/* Parallel scanning.
+   The input is cut after a '\n' into one chunk per thread, and every chunk
+   is scanned speculatively as if it started a line in the normal state.
+   That guess is wrong only when a string literal or block comment of the
+   previous chunk runs across the cut. A prefix pass over the chunks, in
+   order, checks each guess against where the previous chunk really ended:
+   a right guess is kept as it is, a wrong one is rescanned from the end of
+   the straddling token. The chunk tokens are then merged in order through
+   the off-side rule, which interns the IDs and works out the values of
+   the numbers, so the list is the same as
+   tokenizeBuffer() would make. */
+#ifndef PARALLEL_MIN_BYTES
+#define PARALLEL_MIN_BYTES (1 << 20) // smaller inputs are scanned serially
+#endif
+
+static int scanThreadCount = 0; // 0: one thread per online CPU
+
+void setScanThreads(int threads)
+{
+    scanThreadCount = threads;
+}
+
+int scanThreads(void)
+{
+    if (scanThreadCount > 0)
+        return scanThreadCount;
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+typedef struct
+{
+    const char *data; // the whole input
+    size_t len;
+    size_t from;      // the chunk owns the tokens that start in [from, to)
+    size_t to;
+    LexPos pos;       // position at from
+    List tokens;      // offsets are into data; IDs are not interned yet
+    size_t stop;      // end of the last token, may be past to
+    LexPos endPos;    // position at stop
+} Chunk;
+
+/* scanChunk()
+   Scan the tokens that start in [from, to). The last one may run on past
+   to. IDs are not interned here, since the pool is not shared between
+   threads. Errors are recorded in the chunk's list; they only count if
+   the prefix pass keeps the chunk. */
+static void scanChunk(Chunk *c)
+{
+    const char *p = c->data + c->from;
+    const char *to = c->data + c->to;
+    const char *end = c->data + c->len;
+    LexPos pos = c->pos;
+    initList(&c->tokens);
+    reserveTokens(&c->tokens, (int)((c->to - c->from) / 4) + 16);
+    while (p < to)
+    {
+        TokenType type;
+        int line;
+        const char *next = lexToken(&pos, p, end, 1, &type, &line);
+        if (type == ERROR)
+            addDiagnostic(&c->tokens, pos.errorCode, p - c->data, pos.error);
+        if (type != TOKEN_COUNT)
+            pushToken(&c->tokens, type, p - c->data, next - p);
+        p = next;
+    }
+    c->stop = p - c->data;
+    c->endPos = pos;
+}
+
+#ifndef _WIN32
+static void *scanChunkThread(void *arg)
+{
+    scanChunk((Chunk *)arg);
+    return NULL;
+}
+#endif
+
+/* tokenizeBufferParallel()
+   tokenizeBuffer() on up to threads threads. The list is identical to the
+   one tokenizeBuffer() makes. */
+ScanStatus tokenizeBufferParallel(List *list, const char *data, size_t len, int threads)
+{
+#ifdef _WIN32
+    threads = 1; // no thread pool on Windows yet
+#endif
+    if (threads <= 1 || len < PARALLEL_MIN_BYTES)
+        return tokenizeBuffer(list, data, len);
 
-    /*if(strcmp(token,"-")==0)
-    return MINUS;
-    if(strcmp(token,"*")==0)
-    return MUL;
-    if(strcmp(token,"/")==0)
-    return DIV;
-    if(strcmp(token,"%")==0)
-    return MOD;
-    if(strcmp(token,"**")==0)
-    return POWER;
-    if(strcmp(token,"++")==0)
-    return PPLUS;
-    if(strcmp(token,"--")==0)
-    return MMINUS;
-    if(strcmp(token,"<")==0)
-    return LT;
-    if(strcmp(token,">")==0)
-    return GT;
-    if(strcmp(token,"<=")==0)
-    return LTE;
-    if(strcmp(token,">=")==0)
-    return GTE;
-    if(strcmp(token,"==")==0)
-    return EQ;
-    if(strcmp(token,"!=")==0)
-    return UNEQ;
-    if(strcmp(token,"&&")==0)
-    return AAND;
-    if(strcmp(token,"||")==0)
-    return OR;
-    if(strcmp(token,"!")==0)
-    return NOT;
-    if(strcmp(token,"=")==0)
-    return ASSIGN;
-    if(strcmp(token,"+=")==0)
-    return PLUS_ASSIGN;
-    if(strcmp(token,"-=")==0)
-    return MINUS_ASSIGN;
-    if(strcmp(token,"*=")==0)
-    return MUL_ASSIGN;
-    if(strcmp(token,"/=")==0)
-    return DIV_ASSIGN;
-    if(strcmp(token,"%=")==0)
-    return MOD_ASSIGN;
-    if(strcmp(token,"**=")==0)
-    return POWER_ASSIGN;
-    if(strcmp(token,"&")==0)
-    return AND;
-    if(strcmp(token,"<<")==0)
-    return LEFT_SHIFT;
-    if(strcmp(token,">>")==0)
-    return RIGHT_SHIFT; */
-    if (isdigit(token[0]))
-    {
-        int i = 1;
-        while (token[i] != '\0')
+    Chunk *chunks = (Chunk *)calloc(threads, sizeof(Chunk));
+    if (chunks == NULL)
+        return tokenizeBuffer(list, data, len); // the same list, on one thread
+    size_t from = 0;
+    for (int k = 0; k < threads; k++)
+    {
+        size_t to = len;
+        size_t cut = len / threads * (k + 1);
+        if (cut < from)
+            cut = from;
+        if (k < threads - 1 && cut < len)
         {
-            if (token[i] == ':' && isdigit(token[i + 1]))
-                return FRACL;
-            i++;
+            const char *nl = (const char *)memchr(data + cut, '\n', len - cut);
+            to = nl ? (size_t)(nl - data) + 1 : len;
+        }
+        chunks[k].data = data;
+        chunks[k].len = len;
+        chunks[k].from = from;
+        chunks[k].to = to;
+        chunks[k].pos.lineNum = 1; // not tracked: lines come from the line index
+        chunks[k].pos.isStartOfLine = 1;
+        from = to;
+    }
+
+#ifndef _WIN32
+    skipLevel(); // the kernels are chosen on first use: do it here, not in the workers at once
+    pthread_t *workers = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    for (int k = 1; workers != NULL && k < threads; k++, started++)
+    {
+        if (pthread_create(&workers[k], NULL, scanChunkThread, &chunks[k]) != 0)
+            break;
+    }
+    scanChunk(&chunks[0]);
+    for (int k = 1; k <= started; k++)
+        pthread_join(workers[k], NULL);
+    for (int k = started + 1; k < threads; k++) // threads that could not be started
+        scanChunk(&chunks[k]);
+    free(workers);
+#endif
+
+    /* prefix pass: check every speculative start against the previous chunk */
+    int total = 0;
+    for (int k = 0; k < threads; k++)
+    {
+        Chunk *c = &chunks[k];
+        if (k > 0)
+        {
+            Chunk *prev = &chunks[k - 1];
+            if (prev->stop != c->from || !prev->endPos.isStartOfLine)
+            {
+                freeList(&c->tokens);
+                c->from = prev->stop;
+                if (c->to < c->from)
+                    c->to = c->from;
+                c->pos = prev->endPos;
+                scanChunk(c);
+            }
+        }
+        total += c->tokens.size;
+    }
+
+    list->text = (char *)data;
+    list->textLen = len;
+    list->textCap = 0;
+    list->textOwner = TEXT_BORROWED;
+    reserveTokens(list, total + 1);
+    Layout layout;
+    initLayout(&layout);
+    for (int k = 0; k < threads; k++)
+    {
+        List *t = &chunks[k].tokens;
+        Diagnostic *d = t->diag; // one for each ERROR, in order
+        for (int i = 0; i < t->size; i++)
+        {
+            if (t->type[i] == ERROR)
+            {
+                addDiagnostic(list, d->code, d->offset, d->message);
+                d++;
+            }
+            addLayoutToken(list, &layout, (TokenType)t->type[i], t->offset[i], t->length[i]);
         }
-        return INTL;
+        freeList(t);
     }
-    // STRL
-    if (token[0] == '"')
+    addLayoutToken(list, &layout, END_OF_FILE, len, 0);
+    free(chunks);
+    return list->diagCount ? SCAN_ERRORS : SCAN_OK;
+}
+
+/* identifyTokenType()
+   The type of a complete lexeme, using the same DFA as the scanner. A string
+   the DFA cannot consume entirely is an ERROR. */
+TokenType identifyTokenType(const char *token)
+{
+    const char *end = token + strlen(token);
+    const char *tokenEnd;
+    int ranOut;
+    int accepted = runDfa(token, end, &tokenEnd, &ranOut);
+    switch (accepted)
+    {
+    case LEX_LINE_COMMENT:
+    case LEX_BLOCK_COMMENT:
+        return COMMENT;
+    case LEX_STRING:
         return STRL;
-    /*if(strcmp(token,"{")==0)
-    return LCUR;
-    if(strcmp(token,"}")==0)
-    return RCUR;
-    if(strcmp(token,"(")==0)
-    return LPAR;
-    if(strcmp(token,")")==0)
-    return RPAR;
-    if(strcmp(token,"[")==0)
-    return LBRA;
-    if(strcmp(token,"]")==0)
-    return RBRA;
-    if(strcmp(token,"\n")==0)
-    return NEWLINE;
-    if(strcmp(token,":")==0)
-    return COLON;
-    if(strcmp(token,";")==0)
-    return SEMI;
-    if(strcmp(token,",")==0)
-    return COMMA;*/
-   // if(strcmp(token,"#")==0||strcmp(token,"//")==0||strcmp(token,"/*")==0)
-    //return COMMENT; 
-    if (isalpha(token[0]))
-    {
-        if (strcmp(token, "int") == 0)
-            return INT;
-        else if (strcmp(token, "frac") == 0)
-            return FRAC;
-        else if (strcmp(token, "str") == 0)
-            return STR;
-        else if (strcmp(token, "void") == 0)
-            return VOID;
-        else if (strcmp(token, "do") == 0)
-            return DO;
-        else if (strcmp(token, "while") == 0)
-            return WHILE;
-        else if (strcmp(token, "for") == 0)
-            return FOR;
-        else
-            // if(strcmp(token,"def")==0)
-            // return DEF;
-            // else
-            if (strcmp(token, "return") == 0)
-                return RETURN;
-            else if (strcmp(token, "in") == 0)
-                return IN;
-            else if (strcmp(token, "if") == 0)
-                return IF;
-            else if (strcmp(token, "elif") == 0)
-                return ELIF;
-            else if (strcmp(token, "else") == 0)
-                return ELSE;
-            else
-                return ID;
-    }
-    return ERROR;
-}
-void printTokens(const List *list)
-{
-    Node *current = list->head;
-    while (current)
-    {
-        if (current->info == NULL)
-            printf("%s\n", tokenTypeNames[current->type]);
+    case ID:
+        if (tokenEnd == end)
+            return keywordType(token, end - token);
+        return ERROR;
+    default:
+        if (accepted < 0 || tokenEnd != end)
+            return ERROR;
+        return (TokenType)accepted;
+    }
+}
+void printTokens(List *list)
+{
+    for (int i = 0; i < list->size; i++)
+    {
+        const char *info = tokenInfo(list, i);
+        if (info == NULL)
+            printf("%s\n", tokenTypeNames[list->type[i]]);
         else
         {
-            printf("%s", tokenTypeNames[current->type]);
-            printf(":%s\n", current->info);
+            printf("%s", tokenTypeNames[list->type[i]]);
+            printf(":%s\n", info);
         }
-        current = current->next;
     }
 }
+
+/* loadSource()
+   If filename is a regular file, make the whole content available as one
+   buffer: an mmap'd view on POSIX systems, one large read elsewhere. *mapped
+   tells freeList() how to give it back. Returns NULL for pipes, FIFOs and
+   character devices, which must be scanned as a stream, and when the file
+   cannot be opened at all. */
+static char *loadSource(const char *filename, size_t *len, int *mapped)
+{
+    struct stat st;
+    *len = 0;
+    *mapped = 0;
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size > 0)
+    {
+        void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED)
+        {
+            close(fd);
+#ifdef MADV_SEQUENTIAL
+            madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+            *len = (size_t)st.st_size;
+            *mapped = 1;
+            return (char *)view;
+        }
+    }
+    close(fd);
+#else
+    if (stat(filename, &st) != 0 || !(st.st_mode & S_IFREG))
+        return NULL;
+#endif
+    /* Empty file, mmap failure, or no mmap: read it in one go. */
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+        return NULL;
+    char *data = (char *)malloc((size_t)st.st_size + 1);
+    if (data == NULL)
+    {
+        fclose(file);
+        return NULL; // the stream path tries with smaller reads, and fails without exiting
+    }
+    *len = fread(data, 1, (size_t)st.st_size, file);
+    int failed = ferror(file);
+    fclose(file);
+    if (failed)
+    {
+        free(data);
+        return NULL; // scanFile() reads it again as a stream, which reports the error
+    }
+    return data;
+}
+
+static void releaseSource(char *data, size_t len, TextOwner owner)
+{
+#ifndef _WIN32
+    if (owner == TEXT_MAPPED)
+    {
+        munmap(data, len);
+        return;
+    }
+#endif
+    (void)len;
+    if (owner != TEXT_BORROWED)
+        free(data);
+}
+
+/* freeList()
+   Release everything the list owns: one arenaFree() for the token arrays and
+   lexeme copies, plus the source text. The list is left empty. */
 void freeList(List *list)
 {
+    if (list == NULL)
+    {
+        return;
+    }
+    releaseSource(list->text, list->textLen, list->textOwner);
+    arenaFree(&list->arena);
+    initList(list);
+}
+
+/* deleteList()
+   Release a list made by scanFile(), whose header is in its own arena. */
+void deleteList(List *list)
+{
+    if (list == NULL)
+        return;
+    Arena arena = list->arena;
+    releaseSource(list->text, list->textLen, list->textOwner);
+    arenaFree(&arena);
+}
+
+/* printListStats()
+   The stats mode: how much the scan allocated, and from where. */
+void printListStats(const List *list)
+{
+    printf("tokens: %d (capacity %d), trivia: %d, source: %zu bytes\n", list->size, list->capacity, list->triviaCount, list->textLen);
+    arenaPrintStats(&list->arena, "token arena");
+    printf("identifier pool: %d names\n", symbolCount());
+}
+
+/* printDiagnostics()
+   One line for each error recorded while scanning the list. */
+void printDiagnostics(List *list, FILE *out)
+{
+    for (int k = 0; k < list->diagCount; k++)
+    {
+        Diagnostic *d = &list->diag[k];
+        if (d->lineNum == 0)
+            d->lineNum = offsetLineNum(list, d->offset);
+        fprintf(out, "Error: line %d: %s\n", d->lineNum, d->message);
+    }
+}
+
+/* Incremental rescanning.
+   An edit replaces the bytes [start, end) of the text. Only a slice around
+   it is scanned again: from token first, up to token last. Both must
+   start a line at the top level of the layout (no open brace,
+   parenthesis or bracket, and no indentation), with the edit after the
+   first byte of first and at or before last. There the scanner is in the
+   state it has at the start of the input, so the slice scans on its own
+   just as it does inside the whole text. The INDENT/DEDENTs in front of
+   first stay valid, since its line still starts with the same byte.
+   Whether the new slice still ends at the top level is only known once
+   it is scanned. If it does not, or it has an error that could run on
+   past its end (an unterminated comment, say), the rest of the text is
+   scanned as well. The tokens, trivia and literals of the slice then
+   replace the old ones, and the tokens behind it are moved by the change
+   in length. */
+
+/* atTopLevel()
+   Whether layout, after the last line end of a slice, is where the start
+   of the input is: no open frame, parenthesis or bracket. Indentation
+   levels are allowed, since the line at column 1 that follows closes
+   them with the same DEDENTs in both scans. */
+static int atTopLevel(const Layout *layout)
+{
+    if (layout->parens > 0 || !layout->atLineStart || layout->lineWidth != 0)
+        return 0;
+    for (int k = 1; k < layout->depth; k++)
+    {
+        if (layout->stack[k].isBase)
+            return 0;
+    }
+    return 1;
+}
+
+/* scanSlice()
+   Scan [from, to) of the new text into slice as if it were the whole
+   input. Returns 1 if it ends with a line end at the top level and has no
+   errors, so that it stands for the same text inside the list; a comment
+   left open, for one, would not end with a line end. The END_OF_FILE is
+   added either way. */
+static int scanSlice(List *slice, const char *text, size_t from, size_t to)
+{
+    Layout layout;
+    initLayout(&layout);
+    initList(slice);
+    slice->text = (char *)text + from;
+    slice->textLen = to - from;
+    reserveTokens(slice, (int)((to - from) / 4) + 16);
+    scanText(slice, &layout);
+    int n = slice->triviaCount;
+    int ok = slice->diagCount == 0 && atTopLevel(&layout) &&
+             (to == from || (n > 0 && slice->triviaType[n - 1] == NEWLINE &&
+                             slice->triviaOffset[n - 1] + slice->triviaLength[n - 1] == to - from));
+    addLayoutToken(slice, &layout, END_OF_FILE, to - from, 0);
+    return ok;
+}
 
-    if (list == NULL || list->tail == NULL)
+/* replaceText()
+   Put text[0 .. len) in place of [start, end) of list->text. The list
+   takes a copy of its text the first time; after that the edit is made in
+   place while the copy has room. */
+static void replaceText(List *list, size_t start, size_t end, const char *text, size_t len)
+{
+    size_t newLen = list->textLen - (end - start) + len;
+    if (list->textOwner == TEXT_OWNED && newLen <= list->textCap)
+    {
+        memmove(list->text + start + len, list->text + end, list->textLen - end);
+        memcpy(list->text + start, text, len);
+    }
+    else
     {
+        size_t cap = newLen + newLen / 8 + 4096; // room for the edits to come
+        char *copy = (char *)malloc(cap);
+        if (copy == NULL)
+            handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to allocate source text in editList.");
+        memcpy(copy, list->text, start);
+        memcpy(copy + start, text, len);
+        memcpy(copy + start + len, list->text + end, list->textLen - end);
+        releaseSource(list->text, list->textLen, list->textOwner);
+        list->text = copy;
+        list->textCap = cap;
+        list->textOwner = TEXT_OWNED;
+    }
+    list->textLen = newLen;
+}
+
+/* patchLineIndex()
+   Bring the line index, if there is one, up to date with the edit: the
+   lines that start in the old [start, end) go, the ones in text come in,
+   and the ones after move by the change in length. */
+static void patchLineIndex(List *list, size_t start, size_t end, const char *text, size_t len)
+{
+    if (list->lineStart == NULL)
         return;
+    int keep = offsetLineNum(list, start); // lines starting at or before start
+    int tail = offsetLineNum(list, end);   // lines starting at or before end
+    int added = (int)countNewlines(text, text + len);
+    int count = keep + added + (list->lineCount - tail);
+    unsigned *lineStart = list->lineStart;
+    if (count > list->lineCapacity)
+    {
+        int capacity = count + count / 2;
+        lineStart = (unsigned *)arenaAlloc(&list->arena, (size_t)capacity * sizeof(unsigned));
+        memcpy(lineStart, list->lineStart, (size_t)keep * sizeof(unsigned));
+        list->lineCapacity = capacity;
     }
-    while (list->tail != NULL)
+    memmove(lineStart + keep + added, list->lineStart + tail, (size_t)(list->lineCount - tail) * sizeof(unsigned));
+    unsigned delta = (unsigned)len - (unsigned)(end - start); // modulo 2^32
+    for (int k = keep + added; k < count; k++)
+        lineStart[k] += delta;
+    int k = keep;
+    for (size_t i = 0; i < len; i++)
     {
-        Node *temp = list->tail;
-        list->tail = list->tail->prev;
-        free(temp->info);
-        free(temp);
-        list->size--;
+        if (text[i] == '\n')
+            lineStart[k++] = (unsigned)(start + i + 1);
     }
-    list->head = NULL;
+    list->lineStart = lineStart;
+    list->lineCount = count;
+}
+
+/* spliceDiagnostics()
+   The errors of the old text in [from, oldTo) give way to those of slice,
+   scanned from offset from; the ones after move by delta. */
+static void spliceDiagnostics(List *list, List *slice, size_t from, size_t oldTo, unsigned delta)
+{
+    if (list->diagCount == 0 && slice->diagCount == 0)
+        return;
+    Diagnostic *old = list->diag;
+    int oldCount = list->diagCount;
+    list->diag = NULL;
+    list->diagCount = 0;
+    list->diagCapacity = 0;
+    int k = 0;
+    for (; k < oldCount && old[k].offset < from; k++)
+        addDiagnostic(list, old[k].code, old[k].offset, old[k].message);
+    for (int j = 0; j < slice->diagCount; j++)
+        addDiagnostic(list, slice->diag[j].code, slice->diag[j].offset + from, slice->diag[j].message);
+    for (; k < oldCount; k++)
+    {
+        if (old[k].offset >= oldTo)
+            addDiagnostic(list, old[k].code, old[k].offset + delta, old[k].message);
+    }
+}
+
+/* spliceTokens()
+   Put the tokens of slice, scanned from offset from of the new text, in
+   place of tokens [first, lastEnd) of list; the tokens from lastEnd on
+   move by delta bytes. The slice's END_OF_FILE is kept only when it ends
+   the list. The trivia and literals go the same way. */
+static void spliceTokens(List *list, List *slice, int first, int lastEnd, size_t from, unsigned delta)
+{
+    int keepEof = lastEnd == list->size;
+    int count = slice->size - (keepEof ? 0 : 1);
+    int tail = list->size - lastEnd;
+    int size = first + count + tail;
+    reserveTokens(list, size + 1);
+
+    /* trivia: [0, triviaFirst) stay, [triviaFirst, triviaLast) are replaced */
+    int triviaFirst = first > 0 ? (int)list->triviaEnd[first] : 0;
+    int triviaLast = keepEof ? list->triviaCount : (int)list->triviaEnd[lastEnd];
+    int triviaTail = list->triviaCount - triviaLast;
+    int triviaSize = triviaFirst + slice->triviaCount + triviaTail;
+    reserveTrivia(list, triviaSize + 1);
+    memmove(list->triviaType + triviaFirst + slice->triviaCount, list->triviaType + triviaLast, triviaTail);
+    memmove(list->triviaOffset + triviaFirst + slice->triviaCount, list->triviaOffset + triviaLast,
+            (size_t)triviaTail * sizeof(unsigned));
+    memmove(list->triviaLength + triviaFirst + slice->triviaCount, list->triviaLength + triviaLast,
+            (size_t)triviaTail * sizeof(unsigned));
+    for (int k = triviaFirst + slice->triviaCount; k < triviaSize; k++)
+        list->triviaOffset[k] += delta;
+    for (int k = 0; k < slice->triviaCount; k++)
+    {
+        list->triviaType[triviaFirst + k] = slice->triviaType[k];
+        list->triviaOffset[triviaFirst + k] = slice->triviaOffset[k] + (unsigned)from;
+        list->triviaLength[triviaFirst + k] = slice->triviaLength[k];
+    }
+    list->triviaCount = triviaSize;
+
+    /* the tokens behind the slice */
+    int to = first + count;
+    memmove(list->type + to, list->type + lastEnd, tail);
+    memmove(list->offset + to, list->offset + lastEnd, (size_t)tail * sizeof(unsigned));
+    memmove(list->length + to, list->length + lastEnd, (size_t)tail * sizeof(unsigned));
+    memmove(list->aux + to, list->aux + lastEnd, (size_t)tail * sizeof(unsigned));
+    memmove(list->triviaEnd + to, list->triviaEnd + lastEnd, (size_t)tail * sizeof(unsigned));
+    if (list->info)
+        memmove(list->info + to, list->info + lastEnd, (size_t)tail * sizeof(char *));
+    unsigned triviaShift = (unsigned)(triviaFirst + slice->triviaCount) - (unsigned)triviaLast;
+    for (int i = to; i < size; i++)
+    {
+        list->offset[i] += delta;
+        list->triviaEnd[i] += triviaShift;
+    }
+
+    /* the slice; its literals go at the end of the table */
+    int literalBase = list->literalCount;
+    if (literalBase + slice->literalCount > list->literalCapacity)
+    {
+        int capacity = (literalBase + slice->literalCount) * 2;
+        list->literal = (Rational *)growArray(list, list->literal, sizeof(Rational), literalBase, capacity);
+        list->literalCapacity = capacity;
+    }
+    if (slice->literalCount > 0)
+        memcpy(list->literal + literalBase, slice->literal, (size_t)slice->literalCount * sizeof(Rational));
+    list->literalCount += slice->literalCount;
+    for (int k = 0; k < count; k++)
+    {
+        int i = first + k;
+        TokenType type = (TokenType)slice->type[k];
+        list->type[i] = (unsigned char)type;
+        list->offset[i] = slice->offset[k] + (unsigned)from;
+        list->length[i] = slice->length[k];
+        list->aux[i] = slice->aux[k] + (type == INTL || type == FRACL ? (unsigned)literalBase : 0);
+        list->triviaEnd[i] = slice->triviaEnd[k] + (unsigned)triviaFirst;
+        if (list->info)
+            list->info[i] = NULL;
+    }
+    list->size = size;
+}
+
+/* editList()
+   Replace the bytes [start, end) of the list's text by text[0 .. len) and
+   bring the tokens up to date, scanning only the tokens from *first up to
+   last again (see above). text must not point into the list's text.
+   While a string literal is left open, the scan starts over from the
+   first token, since the edit may close it.
+   first = 0 and last = the END_OF_FILE token always do; a first or last
+   that breaks the rules it can check is widened to those. The list takes
+   a copy of its text if it does not own it yet. *first is set to where
+   the scan started. Returns the new index of token last, which is the
+   END_OF_FILE token when the rest of the text had to be scanned too. */
+int editList(List *list, size_t start, size_t end, const char *text, size_t len, int *firstToken, int last)
+{
+    int eof = list->size - 1;
+    int first = *firstToken;
+    for (int k = 0; k < list->diagCount; k++)
+    {
+        if (list->diag[k].code == ERR_UNTERMINATED_STRING)
+            first = 0; // a quote typed anywhere after it can end that string
+    }
+    if (first < 0 || first > eof || (first > 0 && list->offset[first] >= start))
+        first = 0;
+    if (last < first || last > eof || list->offset[last] < end)
+        last = eof;
+    unsigned delta = (unsigned)len - (unsigned)(end - start); // modulo 2^32, like the offsets
+    size_t from = first > 0 ? list->offset[first] : 0;
+    size_t oldTo = last < eof ? list->offset[last] : list->textLen;
+
+    *firstToken = first;
+    patchLineIndex(list, start, end, text, len);
+    replaceText(list, start, end, text, len);
+
+    List slice;
+    int lastEnd = last < eof ? last : list->size;
+    if (!scanSlice(&slice, list->text, from, last < eof ? oldTo - (end - start) + len : list->textLen) && last < eof)
+    {
+        freeList(&slice);
+        lastEnd = list->size;
+        oldTo = list->textLen - len + (end - start);
+        scanSlice(&slice, list->text, from, list->textLen);
+    }
+    int newLast = first + slice.size - 1; // the slice's END_OF_FILE stands where last now is
+    spliceDiagnostics(list, &slice, from, oldTo, delta);
+    spliceTokens(list, &slice, first, lastEnd, from, delta);
+    freeList(&slice);
+    return newLast;
+}
+
+/* newList()
+   An empty list whose header lives in the list's own arena, see deleteList(). */
+static List *newList(void)
+{
+    Arena arena;
+    arenaInit(&arena, LIST_BLOCK_SIZE);
+    List *list = (List *)arenaAlloc(&arena, sizeof(List));
+    initList(list);
+    list->arena = arena;
+    return list;
 }
 
 List* scanFile(const char *filename) {
+    List *tokenList = newList();     // 初始化链表
+
+    /* Regular files are scanned from one buffer, everything else as a stream. */
+    size_t len;
+    int mapped;
+    char *source = loadSource(filename, &len, &mapped);
+    if (source != NULL) {
+        tokenizeBufferParallel(tokenList, source, len, scanThreads());
+        tokenList->textOwner = mapped ? TEXT_MAPPED : TEXT_OWNED; // 由链表负责释放
+        return tokenList;
+    }
+
     FILE *file = fopen(filename, "r");
     if (file == NULL) {
-        printf("Cannot open file %s\n", filename);
-        handleError(ERR_FILE_OPEN_FAILED, filename);
-        exit(1);
-    }
-    List *tokenList = (List *)malloc(sizeof(List));
-    if (!tokenList) {
-        printf("Memory allocation failed for token list.\n");
-        fclose(file);
-        exit(1);
+        deleteList(tokenList);
+        return NULL;                 // 由调用者报告，批处理不必退出
     }
-
-    initList(tokenList);             // 初始化链表
-    tokenizeFile(tokenList, file);   // 扫描文件，生成 Token 链表
+    ScanStatus status = tokenizeFile(tokenList, file); // 扫描文件，生成 Token 链表
     fclose(file);                    // 关闭文件
+    if (status == SCAN_FAILED) {
+        deleteList(tokenList);
+        return NULL;                 // 读不出来，和打不开一样由调用者报告
+    }
 
     return tokenList;                // 返回链表指针
 }
+
+/* scanBuffer()
+   scanFile() for source text that is already in memory: nothing is read
+   or copied. The list borrows data, which must outlive it. */
+List *scanBuffer(const char *data, size_t len)
+{
+    List *tokenList = newList();
+    tokenizeBufferParallel(tokenList, data, len, scanThreads());
+    return tokenList;
+}
+
+#ifndef SCAN_WINDOW
+#define SCAN_WINDOW (64 * 1024) // initial size of the get_token() input window
+#endif
+
+static ScanEnv *newScanEnv(void)
+{
+    ScanEnv *env = (ScanEnv *)calloc(1, sizeof(ScanEnv));
+    if (env == NULL)
+    {
+        handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to allocate a ScanEnv.");
+        return NULL;
+    }
+    env->pos.lineNum = 1;
+    env->pos.isStartOfLine = 1;
+    env->pos.trackLines = 1; // there is no whole text to index later
+    initLayout(&env->layout);
+    return env;
+}
+
+ScanEnv *scanOpenStream(FILE *file)
+{
+    ScanEnv *env = newScanEnv();
+    env->file = file;
+    env->buf = (char *)malloc(SCAN_WINDOW);
+    if (env->buf == NULL)
+    {
+        handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to allocate the scan window.");
+        return NULL;
+    }
+    env->bufCap = SCAN_WINDOW;
+    env->ownsBuf = 1;
+    return env;
+}
+
+ScanEnv *scanOpenFile(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+        return NULL;
+    ScanEnv *env = scanOpenStream(file);
+    env->closeFile = 1;
+    return env;
+}
+
+ScanEnv *scanOpenBuffer(const char *data, size_t len)
+{
+    ScanEnv *env = newScanEnv();
+    env->buf = (char *)data;
+    env->end = len;
+    env->bufCap = len;
+    env->atEof = 1;
+    return env;
+}
+
+/* refill()
+   Move the unscanned bytes to the front of the window, doubling it if they
+   already fill it, and read more behind them. */
+static void refill(ScanEnv *env)
+{
+    if (env->start > 0)
+    {
+        memmove(env->buf, env->buf + env->start, env->end - env->start);
+        env->end -= env->start;
+        env->start = 0;
+    }
+    if (env->end == env->bufCap)
+    {
+        char *bigger = (char *)realloc(env->buf, env->bufCap * 2);
+        if (bigger == NULL)
+        {
+            handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to grow the scan window.");
+            return;
+        }
+        env->buf = bigger;
+        env->bufCap *= 2;
+    }
+    size_t n = fread(env->buf + env->end, 1, env->bufCap - env->end, env->file);
+    env->end += n;
+    if (n == 0)
+        env->atEof = 1;
+}
+
+/* setInfo()
+   Copy the lexeme of the current token into env->info, as tokenInfo() would
+   give it. */
+static void setInfo(ScanEnv *env, const char *lexeme, size_t length)
+{
+    Token *token = &env->token;
+    token->info = NULL;
+    if (token->type == ID)
+    {
+        token->info = (char *)symbolName(token->sym);
+        return;
+    }
+    if (!(token->type == INTL || token->type == FRACL || token->type == STRL || token->type == COMMENT || token->type == ERROR))
+        return;
+    if (length + 1 > env->infoCap)
+    {
+        size_t cap = env->infoCap ? env->infoCap : 64;
+        while (cap < length + 1)
+            cap *= 2;
+        char *info = (char *)realloc(env->info, cap);
+        if (info == NULL)
+        {
+            handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to grow the lexeme buffer in get_token.");
+            return;
+        }
+        env->info = info;
+        env->infoCap = cap;
+    }
+    memcpy(env->info, lexeme, length);
+    env->info[length] = '\0';
+    token->info = env->info;
+}
+
+/* addScanDiagnostic()
+   Record an error found on line lineNum. */
+static void addScanDiagnostic(ScanEnv *env, ErrorCode code, int lineNum, const char *message)
+{
+    if (env->diagCount == env->diagCapacity)
+    {
+        int capacity = env->diagCapacity ? env->diagCapacity * 2 : 8;
+        Diagnostic *diag = (Diagnostic *)realloc(env->diag, capacity * sizeof(Diagnostic));
+        if (diag == NULL)
+        {
+            handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to grow the diagnostics in get_token.");
+            return;
+        }
+        env->diag = diag;
+        env->diagCapacity = capacity;
+    }
+    Diagnostic *d = &env->diag[env->diagCount++];
+    d->code = code;
+    d->offset = 0;
+    d->lineNum = lineNum;
+    d->message = message;
+}
+
+/* nextHeld()
+   Give out the INDENT/DEDENTs due before the held token, then the held
+   token itself. The INDENT's info is its width, kept apart from env->info,
+   which still holds the lexeme of the held token. */
+static Token *nextHeld(ScanEnv *env)
+{
+    Token *token = &env->token;
+    int width;
+    TokenType type = layoutNext(&env->layout, &width);
+    if (type == TOKEN_COUNT)
+    {
+        if (env->layout.tooDeep)
+        {
+            addScanDiagnostic(env, ERR_INDENTATION, env->held.lineNum, "Too many levels of indentation.");
+            env->layout.tooDeep = 0;
+        }
+        env->holding = 0;
+        *token = env->held;
+        return token;
+    }
+    token->type = type;
+    token->info = NULL;
+    token->lineNum = env->held.lineNum;
+    token->sym = NO_SYMBOL;
+    token->width = width;
+    token->value.num = 0;
+    token->value.den = 1;
+    if (type == INDENT)
+    {
+        snprintf(env->widthInfo, sizeof(env->widthInfo), "%d", width);
+        token->info = env->widthInfo;
+    }
+    return token;
+}
+
+/* get_token()
+   The next token of the input, laid out with the off-side rule;
+   END_OF_FILE at the end, and again on every later call. There is no
+   trivia table here: comments and line ends come as tokens. Errors come
+   as ERROR tokens and are recorded in env (see printScanDiagnostics()). The token and
+   its info belong to env and are overwritten by the next call, except the
+   info of an ID, which lives in the identifier pool. */
+Token *get_token(ScanEnv *env)
+{
+    Token *token = &env->token;
+    if (env->holding)
+        return nextHeld(env);
+    for (;;)
+    {
+        if (env->start == env->end)
+        {
+            if (!env->atEof)
+            {
+                refill(env);
+                continue;
+            }
+            token->type = END_OF_FILE;
+            token->info = NULL;
+            token->lineNum = env->pos.lineNum;
+            token->sym = NO_SYMBOL;
+            token->width = 0;
+            token->value.num = 0;
+            token->value.den = 1;
+            break;
+        }
+        const char *p = env->buf + env->start;
+        TokenType type;
+        int line;
+        const char *next = lexToken(&env->pos, p, env->buf + env->end, env->atEof, &type, &line);
+        if (next == NULL)
+        {
+            refill(env);
+            continue;
+        }
+        if (type == ERROR)
+            addScanDiagnostic(env, env->pos.errorCode, line, env->pos.error);
+        env->start = next - env->buf;
+        if (type == TOKEN_COUNT)
+            continue;
+        if (!layoutHold(&env->layout, type, type == INDENT ? indentWidth(p, next - p) : 0))
+            continue;
+        token->type = type;
+        token->lineNum = line;
+        token->sym = type == ID ? internName(p, next - p) : NO_SYMBOL;
+        token->width = 0;
+        token->value.num = 0;
+        token->value.den = 1;
+        if (type == INTL || type == FRACL)
+        {
+            const char *error = parseLiteral(p, next - p, &token->value);
+            if (error != NULL)
+                addScanDiagnostic(env, ERR_BAD_LITERAL, line, error);
+        }
+        setInfo(env, p, next - p);
+        break;
+    }
+    if (token->type == END_OF_FILE)
+        layoutHold(&env->layout, END_OF_FILE, 0);
+    env->held = *token;
+    env->holding = 1;
+    return nextHeld(env);
+}
+
+void scanClose(ScanEnv *env)
+{
+    if (env == NULL)
+        return;
+    if (env->closeFile)
+        fclose(env->file);
+    if (env->ownsBuf)
+        free(env->buf);
+    free(env->info);
+    free(env->diag);
+    free(env);
+}
+
+void printScanDiagnostics(ScanEnv *env, FILE *out)
+{
+    for (int k = 0; k < env->diagCount; k++)
+        fprintf(out, "Error: line %d: %s\n", env->diag[k].lineNum, env->diag[k].message);
+}
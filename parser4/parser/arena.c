@@ -0,0 +1,101 @@
+/****************************************************
+ File: arena.c
+
+ Bump allocation from a chain of blocks. An allocation larger than an
+ ordinary block gets a block of its own, so arenaAlloc() never fails on
+ size, and the space left in the current block is not wasted for it.
+ ****************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include "arena.h"
+#include "error_handler.h"
+
+#define ARENA_ALIGN (alignof(max_align_t))
+#define ARENA_HEADER ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+void arenaInit(Arena *arena, size_t blockSize)
+{
+    arena->head = NULL;
+    arena->blockSize = blockSize;
+    arena->allocCount = 0;
+    arena->blockCount = 0;
+    arena->bytesUsed = 0;
+    arena->bytesReserved = 0;
+}
+
+static ArenaBlock *newBlock(Arena *arena, size_t cap)
+{
+    ArenaBlock *block = (ArenaBlock *)malloc(ARENA_HEADER + cap);
+    if (block == NULL)
+    {
+        handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to allocate an arena block.");
+        return NULL;
+    }
+    block->used = 0;
+    block->cap = cap;
+    arena->blockCount++;
+    arena->bytesReserved += ARENA_HEADER + cap;
+    return block;
+}
+
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    arena->allocCount++;
+    arena->bytesUsed += size;
+    ArenaBlock *head = arena->head;
+    if (head == NULL || head->cap - head->used < size)
+    {
+        if (size > arena->blockSize / 4)
+        {
+            /* a big request gets a block of its own, kept behind the current one */
+            ArenaBlock *block = newBlock(arena, size);
+            block->used = size;
+            if (head == NULL)
+            {
+                block->prev = NULL;
+                arena->head = block;
+            }
+            else
+            {
+                block->prev = head->prev;
+                head->prev = block;
+            }
+            return (char *)block + ARENA_HEADER;
+        }
+        ArenaBlock *block = newBlock(arena, arena->blockSize);
+        block->prev = head;
+        arena->head = head = block;
+    }
+    void *p = (char *)head + ARENA_HEADER + head->used;
+    head->used += size;
+    return p;
+}
+
+char *arenaStrndup(Arena *arena, const char *s, size_t n)
+{
+    char *copy = (char *)arenaAlloc(arena, n + 1);
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+void arenaFree(Arena *arena)
+{
+    ArenaBlock *block = arena->head;
+    while (block != NULL)
+    {
+        ArenaBlock *prev = block->prev;
+        free(block);
+        block = prev;
+    }
+    arenaInit(arena, arena->blockSize);
+}
+
+void arenaPrintStats(const Arena *arena, const char *name)
+{
+    printf("%s: %zu allocations in %zu blocks, %zu bytes used of %zu reserved\n",
+           name, arena->allocCount, arena->blockCount, arena->bytesUsed, arena->bytesReserved);
+}
@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+/* A bump allocator. Memory is taken from large blocks and is never freed
+   piece by piece: arenaFree() gives back every block at once. */
+typedef struct arenaBlock
+{
+  struct arenaBlock *prev; // the block filled before this one
+  size_t used;
+  size_t cap;
+} ArenaBlock;
+
+typedef struct arena
+{
+  ArenaBlock *head;     // block being filled, NULL before the first allocation
+  size_t blockSize;     // size of an ordinary block
+  size_t allocCount;    // number of arenaAlloc() calls
+  size_t blockCount;    // number of blocks malloc'd
+  size_t bytesUsed;     // bytes handed out by arenaAlloc()
+  size_t bytesReserved; // bytes malloc'd for blocks
+} Arena;
+
+void arenaInit(Arena *arena, size_t blockSize);
+void *arenaAlloc(Arena *arena, size_t size);                  // aligned for any type; never NULL
+char *arenaStrndup(Arena *arena, const char *s, size_t n);    // '\0' terminated copy of [s, s + n)
+void arenaFree(Arena *arena);                                 // release every block; the arena can be reused
+void arenaPrintStats(const Arena *arena, const char *name);
+
+#endif
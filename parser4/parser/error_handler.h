@@ -8,10 +8,13 @@ typedef enum
     ERR_FILE_OPEN_FAILED,
     ERR_UNKNOWN_TOKEN,
     ERR_NULL_POINTER,
+    ERR_UNTERMINATED_STRING,
+    ERR_INDENTATION,
+    ERR_BAD_LITERAL,
     // 添加其他错误代码
 } ErrorCode;
 
-// 错误处理函数，打印错误信息并退出程序
+// 错误处理函数，打印错误信息并退出程序；只用于内存不足等致命错误，源文件中的错误由扫描器记录为 Diagnostic
 void handleError(ErrorCode code, const char *details);
 
 #endif // ERROR_HANDLER_H
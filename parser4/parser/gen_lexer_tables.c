@@ -0,0 +1,274 @@
+/****************************************************
+ File: gen_lexer_tables.c
+
+ Build-time generator of the scanner DFA.
+ Usage: gen_lexer_tables <output header>
+
+ The DFA is built over raw bytes from the spellings in TOKEN_LIST
+ (scanner.h), plus identifiers, integer and fraction literals, and the
+ openers of comments and string literals. The bytes that behave the same
+ in every state are then merged into character classes, and the result is
+ written out as three tables:
+   lexCharClass[byte]          character class of a byte
+   lexNext[state][class]       next state, LEX_DEAD when there is none
+   lexAccept[state]            token accepted in that state, -1 if none
+ The scanner runs the DFA for maximal munch: it keeps going while there
+ is a transition and returns the last accepting state it passed.
+
+ The keywords (the spellings that look like identifiers) get a perfect
+ hash keyed on length, first and last character:
+   KW_HASH(s, n) = (n + A * s[0] + B * s[n - 1]) & MASK
+ A, B and MASK are searched for here so that no two keywords collide, and
+ kwTable[] holds each keyword in its slot.
+ ****************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "scanner.h"
+
+#define MAX_STATES 128
+
+/* Accept codes above the TokenType range: the DFA only recognises the
+   opener, the scanner consumes the rest of the comment or string. */
+#define LEX_LINE_COMMENT (TOKEN_COUNT + 0)
+#define LEX_BLOCK_COMMENT (TOKEN_COUNT + 1)
+#define LEX_STRING (TOKEN_COUNT + 2)
+
+static const char *tokenNames[] = {
+#define TOKEN_NAME(name, spelling) #name,
+    TOKEN_LIST(TOKEN_NAME)
+#undef TOKEN_NAME
+};
+
+static const char *spellings[] = {
+#define TOKEN_SPELLING(name, spelling) spelling,
+    TOKEN_LIST(TOKEN_SPELLING)
+#undef TOKEN_SPELLING
+};
+
+static int next[MAX_STATES][256];
+static int accept[MAX_STATES];
+static int stateCount = 0;
+
+static int new_state(void)
+{
+    if (stateCount == MAX_STATES)
+    {
+        fprintf(stderr, "gen_lexer_tables: too many states\n");
+        exit(1);
+    }
+    for (int c = 0; c < 256; c++)
+        next[stateCount][c] = 0;
+    accept[stateCount] = -1;
+    return stateCount++;
+}
+
+/* Add a fixed spelling to the trie that hangs off the start state. */
+static void add_spelling(int start, const char *text, int code)
+{
+    int s = start;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++)
+    {
+        if (next[s][*p] == 0)
+            next[s][*p] = new_state();
+        s = next[s][*p];
+    }
+    if (accept[s] >= 0 && accept[s] != code)
+    {
+        fprintf(stderr, "gen_lexer_tables: \"%s\" is spelled twice\n", text);
+        exit(1);
+    }
+    accept[s] = code;
+}
+
+/* Find A, B and the smallest MASK for which KW_HASH is collision free. */
+static int find_keyword_hash(int *a, int *b, int *mask)
+{
+    for (*mask = 15; *mask <= 255; *mask = *mask * 2 + 1)
+        for (*a = 1; *a < 64; (*a)++)
+            for (*b = 0; *b < 64; (*b)++)
+            {
+                unsigned char used[256] = {0};
+                int t;
+                for (t = 0; t < TOKEN_COUNT; t++)
+                {
+                    const unsigned char *k = (const unsigned char *)spellings[t];
+                    if (k == NULL || !isalpha(k[0]))
+                        continue;
+                    size_t n = strlen(spellings[t]);
+                    int h = (int)(n + *a * k[0] + *b * k[n - 1]) & *mask;
+                    if (used[h])
+                        break;
+                    used[h] = 1;
+                }
+                if (t == TOKEN_COUNT)
+                    return 1;
+            }
+    return 0;
+}
+
+static int is_ident_start(int c)
+{
+    return isalpha(c) || c == '_';
+}
+
+static int is_ident_char(int c)
+{
+    return isalnum(c) || c == '_';
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <output header>\n", argv[0]);
+        return 1;
+    }
+
+    int dead = new_state(); // state 0: no transition
+    int start = new_state();
+    (void)dead;
+
+    /* operators and punctuation; keywords are left to the identifier path */
+    for (int t = 0; t < TOKEN_COUNT; t++)
+    {
+        if (spellings[t] != NULL && !is_ident_start((unsigned char)spellings[t][0]))
+            add_spelling(start, spellings[t], t);
+    }
+    add_spelling(start, "#", LEX_LINE_COMMENT);
+    add_spelling(start, "//", LEX_LINE_COMMENT);
+    add_spelling(start, "/*", LEX_BLOCK_COMMENT);
+    add_spelling(start, "\"", LEX_STRING);
+
+    /* ID --> [A-Za-z_][A-Za-z0-9_]* */
+    int ident = new_state();
+    accept[ident] = ID;
+    /* INTL --> [0-9]+,  FRACL --> [0-9]+ : [0-9]+ */
+    int intl = new_state();
+    int colon = new_state();
+    int fracl = new_state();
+    accept[intl] = INTL;
+    accept[fracl] = FRACL;
+    for (int c = 0; c < 256; c++)
+    {
+        if (is_ident_start(c))
+        {
+            if (next[start][c] != 0)
+            {
+                fprintf(stderr, "gen_lexer_tables: '%c' starts both an identifier and an operator\n", c);
+                return 1;
+            }
+            next[start][c] = ident;
+        }
+        if (is_ident_char(c))
+            next[ident][c] = ident;
+        if (isdigit(c))
+        {
+            next[start][c] = intl;
+            next[intl][c] = intl;
+            next[colon][c] = fracl;
+            next[fracl][c] = fracl;
+        }
+    }
+    next[intl][':'] = colon;
+
+    /* Merge the bytes whose column is identical in every state. */
+    int charClass[256];
+    int classRep[256];
+    int classCount = 0;
+    for (int c = 0; c < 256; c++)
+    {
+        int k;
+        for (k = 0; k < classCount; k++)
+        {
+            int s;
+            for (s = 0; s < stateCount; s++)
+                if (next[s][c] != next[s][classRep[k]])
+                    break;
+            if (s == stateCount)
+                break;
+        }
+        if (k == classCount)
+            classRep[classCount++] = c;
+        charClass[c] = k;
+    }
+
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    fprintf(out, "/* Generated by gen_lexer_tables from TOKEN_LIST in scanner.h. Do not edit. */\n");
+    fprintf(out, "#ifndef LEXER_TABLES_H\n#define LEXER_TABLES_H\n\n");
+    fprintf(out, "#define LEX_STATE_COUNT %d\n", stateCount);
+    fprintf(out, "#define LEX_CLASS_COUNT %d\n", classCount);
+    fprintf(out, "#define LEX_DEAD %d\n", dead);
+    fprintf(out, "#define LEX_START %d\n", start);
+    fprintf(out, "#define LEX_LINE_COMMENT %d\n", LEX_LINE_COMMENT);
+    fprintf(out, "#define LEX_BLOCK_COMMENT %d\n", LEX_BLOCK_COMMENT);
+    fprintf(out, "#define LEX_STRING %d\n\n", LEX_STRING);
+
+    fprintf(out, "static const unsigned char lexCharClass[256] = {");
+    for (int c = 0; c < 256; c++)
+        fprintf(out, "%s%d,", (c % 16) ? " " : "\n    ", charClass[c]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const unsigned char lexNext[LEX_STATE_COUNT][LEX_CLASS_COUNT] = {\n");
+    for (int s = 0; s < stateCount; s++)
+    {
+        fprintf(out, "    {");
+        for (int k = 0; k < classCount; k++)
+            fprintf(out, "%s%d", k ? ", " : "", next[s][classRep[k]]);
+        fprintf(out, "},\n");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const short lexAccept[LEX_STATE_COUNT] = {\n");
+    for (int s = 0; s < stateCount; s++)
+    {
+        const char *name = accept[s] < 0 ? "-" : accept[s] < TOKEN_COUNT ? tokenNames[accept[s]] : "opener";
+        fprintf(out, "    %d, /* %d: %s */\n", accept[s], s, name);
+    }
+    fprintf(out, "};\n\n");
+
+    int a, b, mask;
+    if (!find_keyword_hash(&a, &b, &mask))
+    {
+        fprintf(stderr, "gen_lexer_tables: no perfect hash for the keywords\n");
+        fclose(out);
+        return 1;
+    }
+    size_t minLength = 255, maxLength = 0;
+    const char *slot[256] = {0};
+    int slotType[256];
+    for (int t = 0; t < TOKEN_COUNT; t++)
+    {
+        const unsigned char *k = (const unsigned char *)spellings[t];
+        if (k == NULL || !isalpha(k[0]))
+            continue;
+        size_t n = strlen(spellings[t]);
+        int h = (int)(n + a * k[0] + b * k[n - 1]) & mask;
+        slot[h] = spellings[t];
+        slotType[h] = t;
+        if (n < minLength)
+            minLength = n;
+        if (n > maxLength)
+            maxLength = n;
+    }
+    fprintf(out, "#define KW_MIN_LENGTH %zu\n", minLength);
+    fprintf(out, "#define KW_MAX_LENGTH %zu\n", maxLength);
+    fprintf(out, "#define KW_HASH(s, n) (((n) + %d * (unsigned char)(s)[0] + %d * (unsigned char)(s)[(n) - 1]) & %d)\n\n", a, b, mask);
+    fprintf(out, "static const struct\n{\n    const char *text;\n    unsigned char length;\n    unsigned char type;\n} kwTable[%d] = {\n", mask + 1);
+    for (int h = 0; h <= mask; h++)
+    {
+        if (slot[h])
+            fprintf(out, "    {\"%s\", %zu, %s},\n", slot[h], strlen(slot[h]), tokenNames[slotType[h]]);
+        else
+            fprintf(out, "    {NULL, 0, 0},\n");
+    }
+    fprintf(out, "};\n\n#endif\n");
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,166 @@
+/****************************************************
+ File: intern.c
+
+ The identifier pool: an open addressing hash table (FNV-1a, linear
+ probing, at most half full) from spellings to handles. Handle h indexes
+ the names[] and lengths[] arrays; handle 0 is reserved for NO_SYMBOL.
+ The characters are copied into large blocks that are never moved, so a
+ pointer returned by symbolName() stays valid until internFree().
+ ****************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+#include "error_handler.h"
+
+#define BLOCK_SIZE (64 * 1024)
+
+typedef struct block
+{
+    struct block *next;
+    size_t used;
+    size_t cap;
+    char data[];
+} Block;
+
+static Block *blocks = NULL;
+static const char **names = NULL; // names[h]: spelling of handle h
+static unsigned *lengths = NULL;
+static unsigned *hashes = NULL;
+static int count = 1; // handle 0 is NO_SYMBOL
+static int capacity = 0;
+static Symbol *slots = NULL; // hash table of handles, 0 = empty
+static size_t slotMask = 0;
+
+static unsigned hashBytes(const char *s, size_t n)
+{
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < n; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+/* Copy [s, s + n) and a '\0' into the current block, starting a new one
+   when it is full. */
+static const char *storeChars(const char *s, size_t n)
+{
+    if (blocks == NULL || blocks->cap - blocks->used < n + 1)
+    {
+        size_t cap = n + 1 > BLOCK_SIZE ? n + 1 : BLOCK_SIZE;
+        Block *b = (Block *)malloc(sizeof(Block) + cap);
+        if (b == NULL)
+        {
+            handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to grow the identifier pool.");
+            return NULL;
+        }
+        b->next = blocks;
+        b->used = 0;
+        b->cap = cap;
+        blocks = b;
+    }
+    char *p = blocks->data + blocks->used;
+    memcpy(p, s, n);
+    p[n] = '\0';
+    blocks->used += n + 1;
+    return p;
+}
+
+static void growSlots(void)
+{
+    size_t size = slots == NULL ? 1024 : (slotMask + 1) * 2;
+    Symbol *bigger = (Symbol *)calloc(size, sizeof(Symbol));
+    if (bigger == NULL)
+    {
+        handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to grow the identifier pool.");
+        return;
+    }
+    for (int h = 1; h < count; h++)
+    {
+        size_t i = hashes[h] & (size - 1);
+        while (bigger[i] != NO_SYMBOL)
+            i = (i + 1) & (size - 1);
+        bigger[i] = (Symbol)h;
+    }
+    free(slots);
+    slots = bigger;
+    slotMask = size - 1;
+}
+
+static void growEntries(void)
+{
+    int cap = capacity == 0 ? 1024 : capacity * 2;
+    names = (const char **)realloc(names, cap * sizeof(const char *));
+    lengths = (unsigned *)realloc(lengths, cap * sizeof(unsigned));
+    hashes = (unsigned *)realloc(hashes, cap * sizeof(unsigned));
+    if (names == NULL || lengths == NULL || hashes == NULL)
+    {
+        handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to grow the identifier pool.");
+        return;
+    }
+    names[NO_SYMBOL] = NULL;
+    lengths[NO_SYMBOL] = 0;
+    capacity = cap;
+}
+
+Symbol internName(const char *s, size_t n)
+{
+    if ((size_t)count * 2 >= slotMask + 1)
+        growSlots();
+    unsigned h = hashBytes(s, n);
+    size_t i = h & slotMask;
+    while (slots[i] != NO_SYMBOL)
+    {
+        Symbol sym = slots[i];
+        if (hashes[sym] == h && lengths[sym] == n && memcmp(names[sym], s, n) == 0)
+            return sym;
+        i = (i + 1) & slotMask;
+    }
+    if (count >= capacity)
+        growEntries();
+    Symbol sym = (Symbol)count++;
+    names[sym] = storeChars(s, n);
+    lengths[sym] = (unsigned)n;
+    hashes[sym] = h;
+    slots[i] = sym;
+    return sym;
+}
+
+Symbol internString(const char *s)
+{
+    return internName(s, strlen(s));
+}
+
+const char *symbolName(Symbol sym)
+{
+    return sym != NO_SYMBOL && sym < (Symbol)count ? names[sym] : NULL;
+}
+
+size_t symbolLength(Symbol sym)
+{
+    return sym != NO_SYMBOL && sym < (Symbol)count ? lengths[sym] : 0;
+}
+
+int symbolCount(void)
+{
+    return count - 1;
+}
+
+void internFree(void)
+{
+    while (blocks != NULL)
+    {
+        Block *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+    free(names);
+    free(lengths);
+    free(hashes);
+    free(slots);
+    names = NULL;
+    lengths = NULL;
+    hashes = NULL;
+    slots = NULL;
+    slotMask = 0;
+    count = 1;
+    capacity = 0;
+}
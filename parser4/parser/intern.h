@@ -0,0 +1,21 @@
+#ifndef INTERN_H
+#define INTERN_H
+#include <stddef.h>
+
+/* The identifier pool. Every spelling is stored once and named by a small
+   integer handle, so names can be hashed and compared as integers. The
+   scanner interns each ID as it is scanned; the parser puts the handles
+   in the syntax tree and the symbol table compares them. The strings live
+   in the pool, not in the source text, so they stay valid after the token
+   list is freed, until internFree(). */
+typedef unsigned Symbol;
+#define NO_SYMBOL 0 // no name
+
+Symbol internName(const char *s, size_t n); // handle of [s, s + n), adding it if new
+Symbol internString(const char *s);         // handle of a '\0' terminated string
+const char *symbolName(Symbol sym);         // '\0' terminated spelling; NULL for NO_SYMBOL
+size_t symbolLength(Symbol sym);
+int symbolCount(void);                      // number of distinct names interned
+void internFree(void);                      // release the pool; all handles become invalid
+
+#endif
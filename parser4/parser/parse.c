@@ -1,7 +1,15 @@
+#include <stdarg.h>
+#include <stddef.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
 #include "libs.h"
 #include "scanner.h"
 #include "parse.h"
 #include "util.h"
+#include "scan_skip.h"
+
 
 TreeNode *parse(Parser *p)
 {
@@ -12,9 +20,13 @@ TreeNode *parse(Parser *p)
     }
     ParserInfo *info = (ParserInfo *)p->info;
     info->errorCount = 0;
-    info->currentTokenNode = info->tokenList.head;
+    info->panic = FALSE;
+    info->current = 0;
+    if (info->tokenList)
+        info->eof = info->tokenList->size - 1;
 
-    TreeNode *tree = parse_program(p); // start form program
+    TreeNode *tree = info->tokenList && parseThreads() > 1 ? parse_program_parallel(p, parseThreads())
+                                                           : parse_program(p); // start form program
     if (info->errorCount > 0)
     {
         fprintf(stderr, "There are %d syntax errors in the program\n", info->errorCount);
@@ -22,7 +34,7 @@ TreeNode *parse(Parser *p)
     return tree;
 }
 
-void set_token_list(Parser *p, List tokenList)
+void set_token_list(Parser *p, List *tokenList)
 {
     if (!p->info)
     {
@@ -31,19 +43,58 @@ void set_token_list(Parser *p, List tokenList)
     }
     ParserInfo *info = (ParserInfo *)p->info;
     info->tokenList = tokenList;
-    info->currentTokenNode = tokenList.head;
+    info->eof = tokenList->size - 1;
+    info->quiet = FALSE;
+    info->source = NULL;
+    info->current = 0;
 }
 
+/* set_token_source()
+   Parse straight from a pull scanner: tokens are read from source as the
+   parser reaches them, and only the last PARSE_WINDOW are kept. */
+void set_token_source(Parser *p, ScanEnv *source)
+{
+    if (!p->info)
+    {
+        p->info = malloc(sizeof(ParserInfo));
+        memset(p->info, 0, sizeof(ParserInfo));
+    }
+    ParserInfo *info = (ParserInfo *)p->info;
+    info->tokenList = NULL;
+    info->source = source;
+    info->pulled = 0;
+    info->newLine = TRUE;
+    info->current = 0;
+}
+
+/* free_tree()
+   Release a tree made by parse(): one arenaFree() for every node (see
+   freeTree()). */
 void free_tree(Parser *p, TreeNode *tree)
 {
     if (!tree)
         return;
-    for (int i = 0; i < MAX_CHILDREN; i++)
-    {
-        free_tree(p, tree->child[i]);
-    }
-    free_tree(p, tree->rSibling);
-    free(tree);
+    ParserInfo *info = (ParserInfo *)p->info;
+    if (info->tree == treeOf(tree))
+        info->tree = NULL;
+    freeTree(treeOf(tree));
+}
+
+int syntaxErrorCount(Parser *p)
+{
+    return p->info ? ((ParserInfo *)p->info)->errorCount : 0;
+}
+
+/* printParseStats()
+   Every choice is made from the current token and at most two tokens of
+   lookahead, and current only moves forward, so each token is consumed
+   once. A rolled back node is a parse attempt that was thrown away. */
+void printParseStats(Parser *p)
+{
+    ParserInfo *info = (ParserInfo *)p->info;
+    int total = info->source ? info->pulled : info->tokenList->size;
+    printf("Parser: %d of %d tokens consumed (END_OF_FILE is not), %u nodes rolled back\n",
+           info->current, total, info->tree ? info->tree->rolledBack : 0);
 }
 
 Parser *createParser()
@@ -56,6 +107,7 @@ Parser *createParser()
     }
     p->parse = parse;
     p->set_token_list = set_token_list;
+    p->set_token_source = set_token_source;
     p->free_tree = free_tree;
     p->info = NULL;
     // p->print_tree = print_tree;
@@ -67,6 +119,9 @@ void destroyParser(Parser *p)
     {
         if (p->info)
         {
+            ParserInfo *info = (ParserInfo *)p->info;
+            for (int i = 0; i < PARSE_WINDOW; i++)
+                free(info->window[i].text);
             free(p->info);
         }
         free(p);
@@ -77,195 +132,685 @@ void destroyParser(Parser *p)
  ****************************/
 
 /* 获取当前token类型和lexeme的帮助函数 */
-Token *currentToken(ParserInfo *info)
+/* windowToken()
+   Token index of the source, pulling tokens up to it. Comments and line
+   ends are skipped here, so indexes count the same tokens as a token list,
+   which keeps them in its trivia table. NULL if index is past END_OF_FILE
+   or has already left the window. */
+static WindowToken *windowToken(ParserInfo *info, int index)
 {
-    if (info->currentTokenNode)
+    while (index >= info->pulled)
     {
-        return (info->currentTokenNode->t);
+        if (info->pulled > 0 && info->window[(info->pulled - 1) % PARSE_WINDOW].type == END_OF_FILE)
+            return NULL;
+        Token *token;
+        do
+        {
+            token = get_token(info->source);
+            if (token->type == NEWLINE)
+                info->newLine = TRUE;
+        } while (token->type == COMMENT || token->type == NEWLINE);
+        WindowToken *slot = &info->window[info->pulled % PARSE_WINDOW];
+        /* INDENT/DEDENT come before the first token of a line, so that
+           token still starts it; the layout knows the line's indentation */
+        slot->lineIndent = info->newLine ? info->source->layout.lineWidth : -1;
+        if (token->type != INDENT && token->type != DEDENT)
+            info->newLine = FALSE;
+        slot->type = token->type;
+        slot->lineNum = token->lineNum;
+        slot->sym = token->sym;
+        slot->value = token->value;
+        if (token->info != NULL && token->sym == NO_SYMBOL) // an ID's name is already in the pool
+        {
+            size_t n = strlen(token->info) + 1;
+            if (n > slot->textCap)
+            {
+                free(slot->text);
+                slot->text = (char *)malloc(n);
+                if (!slot->text)
+                {
+                    fprintf(stderr, "Out of memory\n");
+                    exit(1);
+                }
+                slot->textCap = n;
+            }
+            memcpy(slot->text, token->info, n);
+        }
+        else if (slot->text != NULL)
+            slot->text[0] = '\0';
+        info->pulled++;
     }
-    return NULL; // 获得info中当下指向的Node结构体中的token
-} // 获得当前
-Bool checkType(Token *token, TokenType type)
+    if (index < 0 || index < info->pulled - PARSE_WINDOW)
+        return NULL;
+    return &info->window[index % PARSE_WINDOW];
+}
+
+/* hasToken()
+   Whether token index exists. */
+static Bool hasToken(ParserInfo *info, int index)
 {
-    if (token)
+    if (info->source)
+        return windowToken(info, index) != NULL;
+    return index >= 0 && index <= info->eof;
+}
+
+/* Tokens are addressed by their index in the token list; -1 means "no token". */
+int currentToken(ParserInfo *info)
+{
+    if (hasToken(info, info->current))
     {
-        return token->type == type;
+        return info->current;
     }
-    return FALSE;
-} // 检查当下info指向的token的与预期的token类型是否匹配
-
-Bool moveTokenNext(ParserInfo *info)
+    return -1;
+} // 获得当前token的下标
+TokenType tokenType(ParserInfo *info, int index)
 {
-    if (info->currentTokenNode && info->currentTokenNode->next)
+    if (info->source)
     {
-        info->currentTokenNode = info->currentTokenNode->next; // 移动到下一个 Node
-        return TRUE;
+        WindowToken *token = windowToken(info, index);
+        return token ? token->type : END_OF_FILE;
     }
-    return FALSE; // 已经是最后一个节点
-} // 移动token链表的指针，指向下一个节点
-void skipNewlines(ParserInfo *info)
+    if (index >= 0 && index < info->eof)
+    {
+        return (TokenType)info->tokenList->type[index];
+    }
+    return END_OF_FILE;
+}
+const char *tokenText(ParserInfo *info, int index)
 {
-    while (currentToken(info) && currentToken(info)->type == NEWLINE)
+    if (info->source)
     {
-        moveTokenNext(info);
+        WindowToken *token = windowToken(info, index);
+        if (token == NULL || token->sym != NO_SYMBOL)
+            return token ? symbolName(token->sym) : NULL;
+        return token->text != NULL && token->text[0] != '\0' ? token->text : NULL;
     }
+    return tokenInfo(info->tokenList, index);
 }
-Bool checkMove(ParserInfo *info, TokenType type)
+Symbol tokenName(ParserInfo *info, int index)
 {
-    // 跳过 NEWLINE
-    while (info->currentTokenNode && info->currentTokenNode->t->type == NEWLINE)
+    if (info->source)
     {
-        info->currentTokenNode = info->currentTokenNode->next;
+        WindowToken *token = windowToken(info, index);
+        return token ? token->sym : NO_SYMBOL;
     }
-
-    Token *t = info->currentTokenNode ? info->currentTokenNode->t : NULL;
-    if (t && t->type == type)
+    return tokenSymbol(info->tokenList, index);
+} // ID 的标识符句柄
+Rational tokenNumber(ParserInfo *info, int index)
+{
+    if (info->source)
     {
-        if (info->currentTokenNode && info->currentTokenNode->next)
-        {
-            info->currentTokenNode = info->currentTokenNode->next;
-
-            // 再次跳过 NEWLINE
-            while (info->currentTokenNode && info->currentTokenNode->t->type == NEWLINE)
-            {
-                info->currentTokenNode = info->currentTokenNode->next;
-            }
-
-            return TRUE;
-        }
-        else
-        {
-            info->currentTokenNode = NULL; // 已到最后一个 Token
-            return TRUE;
-        }
+        WindowToken *token = windowToken(info, index);
+        if (token == NULL || (token->type != INTL && token->type != FRACL))
+            return makeRational(0, 1);
+        return token->value;
     }
-    return FALSE;
-} // checkType+moveTokenNext，token类型匹配之后移动指针到下一个
-TreeNode *newNode(NodeKind nodeKind)
+    return tokenValue(info->tokenList, index);
+}
+int tokenLine(ParserInfo *info, int index)
 {
-    TreeNode *node = (TreeNode *)malloc(sizeof(TreeNode));
-    if (!node)
+    if (info->source)
     {
-        fprintf(stderr, "Out of memory\n");
-        exit(1);
+        WindowToken *token = windowToken(info, index);
+        return token ? token->lineNum : -1;
     }
-    node->nodeKind = nodeKind;
-    for (int i = 0; i < MAX_CHILDREN; i++)
+    if (index >= 0 && index < info->tokenList->size)
     {
-        node->child[i] = NULL;
+        return tokenLineNum(info->tokenList, index);
     }
-    node->lSibling = NULL;
-    node->rSibling = NULL;
-    node->parent = NULL;
-    node->lineNum = 0;
-    switch (nodeKind)
+    return -1;
+}
+Bool checkType(ParserInfo *info, int index, TokenType type)
+{
+    if (!hasToken(info, index))
+        return FALSE;
+    return tokenType(info, index) == type;
+} // 检查下标为 index 的token的与预期的token类型是否匹配
+
+Bool moveTokenNext(ParserInfo *info)
+{
+    if (hasToken(info, info->current + 1))
     {
-    case DCL_ND:
-        node->kind.dcl = 0;
-        node->attr.dclAttr.type = VOID_TYPE;
-        node->attr.dclAttr.name = NULL;
-        node->attr.dclAttr.size = 0;
-        break;
-    case STMT_ND:
-        node->kind.stmt = 0;
-        break;
-    case EXPR_ND:
-        node->kind.expr = 0;
-        node->attr.exprAttr.op = 0;
-        node->attr.exprAttr.val = 0;
-        node->attr.exprAttr.name = NULL;
-    case PARAM_ND:
-        node->kind.param = 0;
-        node->attr.dclAttr.type = VOID_TYPE;
-        node->attr.dclAttr.name = NULL;
-        node->attr.dclAttr.size = 0;
-        break;
-    case ROOT:
-        break;
-    default:
-        fprintf(stderr, "Unknown node kind\n");
-        exit(1);
+        info->current++; // 移动到下一个 token
+        return TRUE;
     }
-    node->type = VOID_TYPE; // 初始化表达式类型（用于类型检查）
-    node->something = NULL; // 额外字段（可选扩展）
-    return node;
+    return FALSE; // 已经是最后一个token
+} // 移动token的下标，指向下一个token
+Bool checkMove(ParserInfo *info, TokenType type)
+{
+    if (checkType(info, currentToken(info), type))
+    {
+        info->current++;
+        return TRUE;
+    }
+    return FALSE;
+} // checkType+moveTokenNext，token类型匹配之后移动下标到下一个
+Bool isTypeSpecifier(TokenType t)
+{
+    return (t == INT || t == FRAC || t == VOID || t == STR);
 }
 Bool canStartDeclaration(TokenType t)
 {
-    return (t == INT || t == FRAC || t == VOID || t == DEF);
+    return (isTypeSpecifier(t) || t == DEF);
 }
 Bool looksLikeFunDeclaration(ParserInfo *f)
 {
-    if (checkType(f->currentTokenNode->t, INT) || checkType(f->currentTokenNode->t, FRAC) || checkType(f->currentTokenNode->t, VOID) || checkType(f->currentTokenNode->t, DEF))
+    int i = currentToken(f);
+    if (canStartDeclaration(tokenType(f, i)))
     {
-        if (checkType(f->currentTokenNode->next->t, ID))
-        {
-            if (checkType(f->currentTokenNode->next->next->t, LPAR))
-            {
-                return TRUE;
-            }
-        }
+        /* type-specifier ID ( : lookahead is an index, not a pointer chase */
+        return checkType(f, i + 1, ID) && checkType(f, i + 2, LPAR);
     }
     return FALSE;
 }
-void removeNode(TreeNode *node)
+/* Fixed spelling of each token type, NULL where the text varies */
+static const char *tokenSpelling[] = {
+#define TOKEN_SPELLING(name, spelling) spelling,
+    TOKEN_LIST(TOKEN_SPELLING)
+#undef TOKEN_SPELLING
+};
+
+/* shownText()
+   How token index reads in a message: its text, or else its spelling.
+   A quiet parse never prints, and must not make the list copy out the
+   text. */
+static const char *shownText(ParserInfo *f, int index)
+{
+    const char *text = f->quiet ? NULL : tokenText(f, index);
+    if (text == NULL)
+        text = tokenSpelling[tokenType(f, index)];
+    return text != NULL ? text : tokenTypeNames[tokenType(f, index)];
+}
+
+/* startsTopLevelLine()
+   Whether token index is the first on its line and the line is not
+   indented: where a new top-level declaration would start. Both modes go
+   by the layout width of the line, so a comment before the token does
+   not make it indented. INDENT and DEDENT only stand for the layout of
+   the line, so they never do. */
+Bool startsTopLevelLine(ParserInfo *f, int index)
+{
+    if (checkType(f, index, INDENT) || checkType(f, index, DEDENT))
+        return FALSE;
+    if (f->source)
+    {
+        WindowToken *token = windowToken(f, index);
+        return token != NULL && token->lineIndent == 0;
+    }
+    if (index < 0 || index >= f->tokenList->size)
+        return FALSE;
+    int first = index; // 行首可能是这一行的 INDENT/DEDENT
+    while (first > 0 && !tokenStartsLine(f->tokenList, first) &&
+           (checkType(f, first - 1, INDENT) || checkType(f, first - 1, DEDENT)))
+        first--;
+    return tokenStartsLine(f->tokenList, first) && tokenLineWidth(f->tokenList, first) == 0;
+}
+
+static Bool startsTopLevelDeclaration(ParserInfo *f, int index)
+{
+    return canStartDeclaration(tokenType(f, index)) && startsTopLevelLine(f, index);
+}
+
+/* syntaxError()
+   Report a syntax error at token index and count it. After the first
+   error the productions above it fail one after another; while the parser
+   is in that state (panic) their messages would only repeat the first, so
+   they are dropped until a synchronize function gets it back on track. */
+void syntaxError(ParserInfo *f, int index, const char *format, ...)
+{
+    if (f->panic)
+        return;
+    f->panic = TRUE;
+    f->errorCount++;
+    if (f->quiet)
+        return; // the tokens are parsed again to report it
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "Syntax error (line %d): ", tokenLine(f, index));
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+/* synchronizeStatement()
+   After a statement starting at token start failed: skip to just after a
+   ';', or to a '}', a DEDENT, the end of the input or a declaration at the
+   start of an unindented line (the block was never closed), whichever
+   comes first. At least one token is skipped unless the failure was at
+   one of those stops, so the caller always moves on. */
+void synchronizeStatement(ParserInfo *f, int start)
 {
-    if (node)
+    syntaxError(f, start, "Invalid statement"); // 下层没有报告时才会打印
+    int t = currentToken(f);
+    while (t >= 0 && !checkType(f, t, END_OF_FILE))
     {
-        free(node);
+        TokenType type = tokenType(f, t);
+        if (type == RCUR || type == DEDENT || (t > start && startsTopLevelDeclaration(f, t)))
+            break;
+        moveTokenNext(f);
+        if (type == SEMI)
+            break;
+        t = currentToken(f);
     }
+    f->panic = FALSE;
+}
+
+/* synchronizeDeclaration()
+   After a declaration starting at token start failed: skip to the start
+   of the next unindented line, or to the end of the input. A '}' at the
+   start of an unindented line closes the broken function and is skipped
+   too. */
+void synchronizeDeclaration(ParserInfo *f, int start)
+{
+    syntaxError(f, start, "Invalid declaration");
+    int t = currentToken(f);
+    while (t >= 0 && !checkType(f, t, END_OF_FILE))
+    {
+        if (t > start && startsTopLevelLine(f, t))
+        {
+            if (!checkType(f, t, RCUR))
+                break;
+            start = t; // 跳过这个 '}'，停在下一行
+        }
+        moveTokenNext(f);
+        t = currentToken(f);
+    }
+    f->panic = FALSE;
 }
 /****************************
  * 文法解析函数 *
  ***************************/
 /*program --> declaration-list*/
 
-/*declaration_list -> declaration_list declaration | declaration*/
+/*program --> declaration-list
+  With syntax errors the tree holds the declarations that did parse; see
+  syntaxErrorCount(). */
 TreeNode *parse_program(Parser *p)
 {
-    TreeNode *root = newNode(ROOT);
+    ParserInfo *f = (ParserInfo *)p->info;
+    f->tree = newTree();
+    TreeNode *root = treeRoot(f->tree);
     Bool s;
-    if ((root->child[0] = declaration_list(p->info, &s)), s == TRUE)
+    setChild(root, 0, declaration_list(f, &s));
+    return root;
+}
+
+/* Parallel parsing of the top-level declarations.
+   A top-level declaration starts an unindented line outside every brace,
+   so one pass over the token list finds where they begin. The list is cut
+   there into one share per thread, and each share is parsed by
+   declaration_list() on its own ParserInfo into its own tree, with the
+   first token of the next share read as END_OF_FILE. The trees are then
+   appended in order under one ROOT, which gives the tree parse_program()
+   makes. A worker only reads the token list and the identifier pool: the
+   line index is built before the workers start, and the strings are
+   interned after they are done. If a share has a syntax error, the whole
+   list is parsed again serially, so errors are reported and recovered
+   from exactly as parse_program() does it. */
+#ifndef PARSE_PARALLEL_MIN_TOKENS
+#define PARSE_PARALLEL_MIN_TOKENS (1 << 16) // smaller lists are parsed serially
+#endif
+
+static int parseThreadCount = 1;
+
+void setParseThreads(int threads)
+{
+    parseThreadCount = threads;
+}
+
+int parseThreads(void)
+{
+    if (parseThreadCount > 0)
+        return parseThreadCount;
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+typedef struct
+{
+    ParserInfo info; // the share is the tokens [info.current, info.eof)
+    TreeNode *head;  // its first declaration
+    Bool ok;
+} Share;
+
+static void parseShare(Share *share)
+{
+    Bool s;
+    share->info.tree = newTree();
+    share->head = declaration_list(&share->info, &s);
+    share->ok = s && share->info.current == share->info.eof;
+}
+
+#ifndef _WIN32
+static void *parseShareThread(void *arg)
+{
+    parseShare((Share *)arg);
+    return NULL;
+}
+#endif
+
+/* findShares()
+   cut[k] is where share k starts, for k < the count returned, and
+   cut[count] is f->eof. Share k starts at the first top-level declaration
+   at or after the k-th part of the list. */
+static int findShares(ParserInfo *f, int threads, int *cut)
+{
+    int count = 1;
+    int depth = 0; // braces
+    cut[0] = 0;
+    for (int i = 0; i < f->eof && count < threads; i++)
+    {
+        TokenType type = tokenType(f, i);
+        if (type == LCUR)
+            depth++;
+        else if (type == RCUR && depth > 0)
+            depth--;
+        else if (depth == 0 && i > cut[count - 1] && i >= (long long)f->eof * count / threads &&
+                 startsTopLevelDeclaration(f, i))
+            cut[count++] = i;
+    }
+    cut[count] = f->eof;
+    return count;
+}
+
+/* internStrings()
+   A quiet parse keeps the token of a string constant in extra instead of
+   interning it, as a share runs on its own thread and the identifier
+   pool is not thread safe. Intern the strings of the nodes from first on. */
+static void internStrings(ParserInfo *f, NodeId first)
+{
+    for (NodeId id = first; id < f->tree->nodeCount; id++)
     {
-        return root;
+        TreeNode *node = nodeAt(f->tree, id);
+        if (node->nodeKind == EXPR_ND && node->kind == CONST_EXPR && node->type == STR_TYPE)
+        {
+            node->name = internString(tokenText(f, (int)node->extra));
+            node->extra = 0;
+        }
     }
-    else
+}
+
+/* parse_program_parallel()
+   parse_program() on up to threads threads, for a token list. The tree
+   is the same as the one parse_program() makes. */
+TreeNode *parse_program_parallel(Parser *p, int threads)
+{
+    ParserInfo *f = (ParserInfo *)p->info;
+#ifdef _WIN32
+    threads = 1; // no thread pool on Windows yet
+#endif
+    if (f->source || threads <= 1 || f->eof < PARSE_PARALLEL_MIN_TOKENS)
+        return parse_program(p);
+
+    int *cut = (int *)malloc((threads + 1) * sizeof(int));
+    Share *shares = (Share *)calloc(threads, sizeof(Share));
+    if (cut == NULL || shares == NULL)
     {
-        printf("Error:Failed to parse declaration_list in program. \n");
-        removeNode(root);
-        return NULL;
+        free(cut);
+        free(shares);
+        return parse_program(p);
     }
-    return root;
+    int count = findShares(f, threads, cut);
+    for (int k = 0; k < count; k++)
+    {
+        shares[k].info.tokenList = f->tokenList;
+        shares[k].info.current = cut[k];
+        shares[k].info.eof = cut[k + 1];
+        shares[k].info.quiet = TRUE;
+    }
+    tokenLineNum(f->tokenList, 0); // builds the line index every share reads
+
+#ifndef _WIN32
+    pthread_t *workers = (pthread_t *)malloc(count * sizeof(pthread_t));
+    int started = 0;
+    for (int k = 1; workers != NULL && k < count; k++, started++)
+    {
+        if (pthread_create(&workers[k], NULL, parseShareThread, &shares[k]) != 0)
+            break;
+    }
+    parseShare(&shares[0]);
+    for (int k = 1; k <= started; k++)
+        pthread_join(workers[k], NULL);
+    for (int k = started + 1; k < count; k++) // threads that could not be started
+        parseShare(&shares[k]);
+    free(workers);
+#else
+    for (int k = 0; k < count; k++)
+        parseShare(&shares[k]);
+#endif
+
+    Bool ok = TRUE;
+    for (int k = 0; k < count; k++)
+        ok = ok && shares[k].ok;
+    TreeNode *root = NULL;
+    if (ok)
+    {
+        f->tree = newTree();
+        root = treeRoot(f->tree);
+        TreeNode *tail = NULL;
+        for (int k = 0; k < count; k++)
+        {
+            NodeId first = f->tree->nodeCount;
+            NodeId delta = appendTree(f->tree, shares[k].info.tree);
+            TreeNode *head = nodeAt(f->tree, shares[k].head->self + delta);
+            internStrings(f, first);
+            if (tail == NULL)
+                setChild(root, 0, head);
+            else
+                setSibling(tail, head);
+            for (tail = head; nodeSibling(tail) != NULL; tail = nodeSibling(tail))
+                ;
+        }
+        f->current = f->eof;
+    }
+    for (int k = 0; k < count; k++)
+        freeTree(shares[k].info.tree);
+    free(shares);
+    free(cut);
+    return ok ? root : parse_program(p);
 }
-/*declaration_list -> declaration_list declaration | declaration*/
-TreeNode *declaration_list(ParserInfo *f, Bool *status)
+/* Incremental reparsing.
+   After an edit of the source, only the top-level declarations it touches
+   are parsed again. The token list is brought up to date by editList(),
+   which scans again from the start of the last declaration that begins
+   before the edit up to the start of the first one that begins on a line
+   after it. Those tokens are parsed quietly, as a share is, and the new
+   declarations take the place of the old ones in the sibling chain under
+   ROOT. The declarations behind the edit keep their nodes; only their
+   line numbers move when the edit adds or removes lines. The nodes taken
+   out stay in the pages until the tree is parsed again from scratch,
+   which happens once they are more than half of it. A declaration is
+   only used as a bound if its first token is known for sure (see
+   declarationToken()); anything the region cannot handle, a syntax error
+   above all, is parsed again from scratch, so errors are reported and
+   recovered from exactly as parse() does it. */
+
+/* declarationToken()
+   The token top-level declaration decl starts with, or -1 if that is not
+   certain: it must be the first token of line decl->lineNum, not counting
+   the INDENT/DEDENTs of the line, start a declaration at column 1, and be
+   the only declaration starting on that line. */
+static int declarationToken(ParserInfo *f, TreeNode *decl)
 {
-    TreeNode *result = NULL;
-    Bool s;
-    skipNewlines(f);
-    TreeNode *firstDecl = declaration(f, &s);
-    if (s == FALSE)
+    List *list = f->tokenList;
+    TreeNode *prev = nodePrevSibling(decl);
+    if (decl->lineNum < 1 || (prev != NULL && prev->lineNum == decl->lineNum))
+        return -1;
+    tokenLineNum(list, 0); // builds the line index
+    if (decl->lineNum > list->lineCount)
+        return -1;
+    unsigned lineStart = list->lineStart[decl->lineNum - 1];
+    int lo = 0, hi = f->eof; // the first token at or after lineStart
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (list->offset[mid] < lineStart)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    while (checkType(f, lo, INDENT) || checkType(f, lo, DEDENT))
+        lo++;
+    if (lo < f->eof && canStartDeclaration(tokenType(f, lo)) && startsTopLevelLine(f, lo) &&
+        tokenLine(f, lo) == decl->lineNum)
+        return lo;
+    return -1;
+}
+
+static void *countNode(TreeNode *node, void *context, void *data)
+{
+    (void)node;
+    (*(NodeId *)data)++;
+    return context;
+}
+
+/* parseAgain()
+   Parse the whole (edited) token list from scratch into a new tree, and
+   free old. */
+static TreeNode *parseAgain(Parser *p, TreeNode *old)
+{
+    TreeNode *tree = parse(p);
+    freeTree(treeOf(old));
+    return tree;
+}
+
+/* reparseEdit()
+   The source of tree, the token list p parsed it from, has had its bytes
+   [start, end) replaced by text[0 .. len). Bring the token list and the
+   tree up to date, parsing only the declarations the edit touches (see
+   above). Returns the ROOT of the tree: tree itself, or a new tree when
+   everything was parsed again, and then tree is freed. */
+TreeNode *reparseEdit(Parser *p, TreeNode *tree, size_t start, size_t end, const char *text, size_t len)
+{
+    ParserInfo *f = (ParserInfo *)p->info;
+    List *list = f->tokenList;
+    f->eof = list->size - 1;
+    if (f->errorCount > 0 || f->tree != treeOf(tree))
+    {
+        int first = 0;
+        editList(list, start, end, text, len, &first, f->eof);
+        return parseAgain(p, tree);
+    }
+    int firstLine = offsetLineNum(list, start);
+    int lastLine = offsetLineNum(list, end);
+    int lineDelta = (int)countNewlines(text, text + len) -
+                    (int)countNewlines(list->text + start, list->text + end);
+
+    /* The last declaration that starts before the edit, and the first one
+       that starts on a line after it: the tokens in between are parsed
+       again. Without the first, the tokens are parsed from the start. */
+    TreeNode *firstDecl = NULL;
+    TreeNode *after = nodeChild(tree, 0);
+    for (; after != NULL && after->lineNum <= firstLine; after = nodeSibling(after))
+        firstDecl = after;
+    int first = -1;
+    while (firstDecl != NULL && ((first = declarationToken(f, firstDecl)) < 0 || list->offset[first] >= start))
+        firstDecl = nodePrevSibling(firstDecl);
+    int last = -1;
+    while (after != NULL && (after->lineNum <= lastLine || (last = declarationToken(f, after)) < 0))
+        after = nodeSibling(after);
+    if (firstDecl == NULL)
+        first = 0;
+    if (after == NULL)
+        last = f->eof;
+
+    int requested = first;
+    int newLast = editList(list, start, end, text, len, &first, last);
+    if (first != requested)
+        firstDecl = NULL; // the scan had to start over, so does the parse
+    if (newLast == list->size - 1)
+        after = NULL;
+
+    NodeId mark = f->tree->nodeCount;
+    TreeNode *head = NULL;
+    Bool s = TRUE;
+    f->current = first;
+    f->eof = newLast;
+    f->panic = FALSE;
+    f->quiet = TRUE;
+    if (first < newLast)
+        head = declaration_list(f, &s);
+    f->quiet = FALSE;
+    if (!s || f->current != newLast || (head == NULL && first == 0 && newLast == list->size - 1))
+        return parseAgain(p, tree); // also for a list left empty, which is an error
+    internStrings(f, mark);
+    f->eof = list->size - 1;
+    f->current = f->eof;
+
+    /* Take the old declarations out, and link the new ones in. */
+    TreeNode *gone = firstDecl != NULL ? firstDecl : nodeChild(tree, 0);
+    TreeNode *before = firstDecl != NULL ? nodePrevSibling(firstDecl) : NULL;
+    int bodyStart, bodyEnd;
+    if (gone != after)
+    {
+        for (TreeNode *decl = gone; decl != after; decl = nodeSibling(decl))
+        {
+            if (nodeLazyBody(decl, &bodyStart, &bodyEnd))
+                setLazyBody(decl, 0, 0); // its tokens are gone
+        }
+        if (after != NULL)
+            nodePrevSibling(after)->rSibling = NO_NODE;
+        traverseTree(gone, NULL, countNode, NULL, &f->tree->replaced);
+    }
+    for (TreeNode *decl = after; f->tree->pendingBodies > 0 && decl != NULL && newLast != last; decl = nodeSibling(decl))
+    {
+        if (nodeLazyBody(decl, &bodyStart, &bodyEnd))
+            setLazyBody(decl, bodyStart + newLast - last, bodyEnd + newLast - last);
+    }
+    TreeNode *tail = head;
+    while (tail != NULL && nodeSibling(tail) != NULL)
+        tail = nodeSibling(tail);
+    if (tail != NULL)
+        setSibling(tail, after);
+    TreeNode *next = head != NULL ? head : after;
+    if (before != NULL)
+        setSibling(before, next);
+    else
     {
-        printf("Error: expected at least one declaration.\n");
-        *status = FALSE;
-        return NULL;
+        setChild(tree, 0, next);
+        if (next != NULL)
+            next->lSibling = NO_NODE;
     }
-    result = firstDecl;
+    if (after != NULL && after != nodeChild(tree, 0))
+        after->parent = NO_NODE;
+    if (after != NULL && lineDelta != 0)
+        shiftLines(f->tree, mark, lastLine, lineDelta); // the new nodes have their lines already
 
-    TreeNode *currentNode = firstDecl;
-    while (canStartDeclaration(currentToken(f)->type))
+    if (f->tree->replaced > f->tree->nodeCount / 2)
+        return parseAgain(p, tree);
+    return tree;
+}
+/*declaration_list -> declaration_list declaration | declaration
+  A declaration that fails is reported and skipped up to the next
+  unindented line, and the list goes on from there. */
+TreeNode *declaration_list(ParserInfo *f, Bool *status)
+{
+    TreeNode *head = NULL;
+    TreeNode *tail = NULL;
+    Bool s;
+    int t = currentToken(f);
+    if (t < 0 || checkType(f, t, END_OF_FILE))
+        syntaxError(f, t, "Expected at least one declaration");
+    while (t >= 0 && !checkType(f, t, END_OF_FILE))
     {
-        TreeNode *nextDecl = declaration(f, &s);
+        TreeNode *decl = declaration(f, &s);
         if (s == FALSE)
+            synchronizeDeclaration(f, t);
+        else if (head == NULL)
+            head = tail = decl;
+        else
         {
-            break;
+            setSibling(tail, decl);
+            tail = decl;
         }
-        currentNode->rSibling = nextDecl;
-        nextDecl->lSibling = currentNode;
-        currentNode = nextDecl;
+        t = currentToken(f);
     }
-    *status = TRUE;
-    return result;
+    *status = f->errorCount == 0 ? TRUE : FALSE;
+    return head;
 }
 /*declaration -> var_declaration | fun_declaration*/
 TreeNode *declaration(ParserInfo *f, Bool *status)
@@ -284,112 +829,107 @@ TreeNode *declaration(ParserInfo *f, Bool *status)
     *status = s;
     return node;
 }
-/*var_declaration -> type_specifier ID  | type_specifier ID LBRA INTL RBRA*/
+/*var_declaration -> type_specifier ID [;] | type_specifier ID LBRA INTL RBRA [;]*/
 TreeNode *var_declaration(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(DCL_ND);
-    Bool s;
-    Token *typeToken = currentToken(f);
+    TreeMark mark = treeMark(f->tree);
+    TreeNode *node = newNode(f->tree, DCL_ND);
+    int typeToken = currentToken(f);
+    node->lineNum = tokenLine(f, typeToken);
     if (checkMove(f, INT) || checkMove(f, FRAC) || checkMove(f, VOID) || checkMove(f, STR))
     {
-        switch (typeToken->type)
+        switch (tokenType(f, typeToken))
         {
         case INT:
-            node->attr.dclAttr.type = INT_TYPE;
+            node->type = INT_TYPE;
             break;
         case FRAC:
-            node->attr.dclAttr.type = FRAC_TYPE;
+            node->type = FRAC_TYPE;
             break;
         case VOID:
-            node->attr.dclAttr.type = VOID_TYPE;
+            node->type = VOID_TYPE;
             break;
         case STR:
-            node->attr.dclAttr.type = STR_TYPE;
+            node->type = STR_TYPE;
             break;
         default:
-            fprintf(stderr, "Unknown type\n");
-            exit(1);
-            removeNode(node);
-            return NULL;
+            break;
         }
-        Token *idToken = currentToken(f);
+        int idToken = currentToken(f);
         if (checkMove(f, ID))
         {
-            node->attr.dclAttr.name = idToken->info;
-            if (checkType(currentToken(f), LBRA))
+            node->name = tokenName(f, idToken);
+            node->kind = VAR_DCL;
+            if (checkMove(f, LBRA))
             {
-                Token *sizeToken = currentToken(f);
-                moveTokenNext(f);
-                if (checkType(currentToken(f), INTL))
+                int sizeToken = currentToken(f);
+                if (!checkMove(f, INTL))
                 {
-                    node->kind.dcl = ARRAY_DCL;
-                    node->attr.dclAttr.size = atoi(sizeToken->info);
-                    if (!checkMove(f, RBRA))
-                    {
-                        fprintf(stderr, "Error: missing ']' in array declaration.\n");
-                        *status = FALSE;
-                        removeNode(node);
-                        return NULL;
-                    }
+                    syntaxError(f, currentToken(f), "Missing array size in array declaration");
+                    *status = FALSE;
+                    treeRollback(f->tree, mark);
+                    return NULL;
                 }
-                else
+                node->kind = ARRAY_DCL;
+                setArraySize(node, (int)tokenNumber(f, sizeToken).num);
+                if (!checkMove(f, RBRA))
                 {
-                    fprintf(stderr, "Error: missing array size in array declaration.\n");
+                    syntaxError(f, currentToken(f), "Missing ']' in array declaration");
                     *status = FALSE;
-                    removeNode(node);
+                    treeRollback(f->tree, mark);
                     return NULL;
                 }
             }
-            else
-            {
-                node->kind.dcl = VAR_DCL;
-                node->attr.dclAttr.size = 0;
-            }
+            checkMove(f, SEMI); // 缩进写法的声明可以不写 ';'
+            *status = TRUE;
+            return node;
         }
     }
-    printf("something wrong");
+    syntaxError(f, currentToken(f), "Expected a variable declaration, found '%s'", shownText(f, currentToken(f)));
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
 /*fun-declaration --> type-specifier ID ( param-list ) compound-stmt | def ID (param-list): compound-stmt*/
 TreeNode *fun_declaration(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(DCL_ND);
-    node->kind.dcl = FUN_DCL;
+    TreeMark mark = treeMark(f->tree);
+    TreeNode *node = newNode(f->tree, DCL_ND);
+    node->kind = FUN_DCL;
     Bool s;
-    Token *typeToken = currentToken(f); // 获取函数返回类型
-    if (checkType(typeToken, INT) || checkType(typeToken, FRAC) || checkType(typeToken, VOID))
+    int typeToken = currentToken(f); // 获取函数返回类型
+    node->lineNum = tokenLine(f, typeToken);
+    if (checkType(f, typeToken, INT) || checkType(f, typeToken, FRAC) || checkType(f, typeToken, VOID))
     {
-        switch (typeToken->type)
+        switch (tokenType(f, typeToken))
         {
         case INT:
-            node->attr.dclAttr.type = INT_TYPE;
+            node->type = INT_TYPE;
             break;
         case FRAC:
-            node->attr.dclAttr.type = FRAC_TYPE;
+            node->type = FRAC_TYPE;
             break;
         case VOID:
-            node->attr.dclAttr.type = VOID_TYPE;
+            node->type = VOID_TYPE;
             break;
         default:
-            fprintf(stderr, "Unknown return type in function declaration.\n");
+            syntaxError(f, typeToken, "Unknown return type in function declaration");
             *status = FALSE;
-            removeNode(node);
+            treeRollback(f->tree, mark);
             return NULL;
         }
         moveTokenNext(f);
-        Token *idToken = currentToken(f); // 获取函数名
+        int idToken = currentToken(f); // 获取函数名
         if (checkMove(f, ID))
         {
-            node->attr.dclAttr.name = idToken->info;
+            node->name = tokenName(f, idToken);
             if (checkMove(f, LPAR))
             {
-                if ((node->child[0] = param_list(f, &s)), s == TRUE)
+                if ((setChild(node, 0, param_list(f, &s)), s == TRUE))
                 {
                     if (checkMove(f, RPAR))
                     {
-                        if ((node->child[1] = compound_stmt(f, &s)), s == TRUE)
+                        if ((setChild(node, 1, function_body(f, node, &s)), s == TRUE))
                         {
                             *status = TRUE;
                             return node;
@@ -397,59 +937,161 @@ TreeNode *fun_declaration(ParserInfo *f, Bool *status)
                     }
                     else
                     {
-                        fprintf(stderr, "Error: missing ')' in function declaration.\n");
+                        syntaxError(f, currentToken(f), "Missing ')' in function declaration");
                     }
                 }
                 else
                 {
-                    fprintf(stderr, "Error: missing parameters in function declaration.\n");
+                    syntaxError(f, currentToken(f), "Missing parameters in function declaration");
                 }
             }
         }
     }
     else if (checkMove(f, DEF))
     {
-        Token *idToken = currentToken(f); // 获取函数名
+        int idToken = currentToken(f); // 获取函数名
         if (checkMove(f, ID))
         {
-            node->attr.dclAttr.name = idToken->info;
-            node->attr.dclAttr.type = VOID_TYPE;
+            node->name = tokenName(f, idToken);
+            node->type = VOID_TYPE;
             if (checkMove(f, LPAR))
             {
-                if ((node->child[0] = param_list(f, &s)), s == TRUE)
+                if ((setChild(node, 0, param_list(f, &s)), s == TRUE))
                 {
                     if (checkMove(f, RPAR))
                     {
                         if (checkMove(f, COLON))
                         {
-                            if ((node->child[1] = compound_stmt(f, &s)), s == TRUE)
+                            if ((setChild(node, 1, function_body(f, node, &s)), s == TRUE))
                             {
                                 *status = TRUE;
                                 return node;
                             }
                             else
                             {
-                                fprintf(stderr, "Error: failed to parse function body.\n");
+                                syntaxError(f, currentToken(f), "Invalid function body");
                             }
                         }
                         else
                         {
-                            fprintf(stderr, "Error: missing ':' in function declaration.\n");
+                            syntaxError(f, currentToken(f), "Missing ':' in function declaration");
                         }
                     }
                 }
             }
         }
     }
-    printf("something wrong");
+    syntaxError(f, currentToken(f), "Invalid function declaration at '%s'", shownText(f, currentToken(f)));
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
-/*param-list --> param-list, param | param | empty*/
+/* Lazy function bodies.
+   Tools that only need the declarations and signatures (an outline, a
+   symbol search, an arity check of calls) do not need the statements. In
+   lazy mode fun_declaration() only skims the tokens of a body up to the
+   '}' or DEDENT that closes it, and keeps where they are in the DclInfo of
+   the function. The body is parsed the first time its child slot is
+   looked at, by nodeChild() or traverseTree(), which is how the printer
+   and the analyzer get at it, so they need not know. The token list must
+   then outlive the tree. Syntax errors in a body are reported when it is
+   parsed, and are not in syntaxErrorCount(). Only a token list can be
+   skimmed: a pull scanner does not keep the tokens for later. */
+static Bool lazyBodyMode = FALSE;
+
+void setLazyBodies(Bool lazy)
+{
+    lazyBodyMode = lazy;
+}
+
+Bool lazyBodies(void)
+{
+    return lazyBodyMode;
+}
+
+/* function_body()
+   compound_stmt for the body of function fun, or with lazy bodies the
+   tokens of it skimmed (see above). The skim also checks that the
+   parentheses and brackets in the body, and the braces in an indented
+   body, are balanced, as they are in a body that parses. A body that
+   breaks that, or is not closed before the next top-level declaration,
+   is parsed right away, so its errors are reported and recovered from as
+   usual, and the declarations after it start at the top level. */
+TreeNode *function_body(ParserInfo *f, TreeNode *fun, Bool *status)
+{
+    int start = currentToken(f);
+    TokenType open = tokenType(f, start);
+    if (lazyBodyMode && f->tokenList != NULL && (open == LCUR || open == INDENT))
+    {
+        TokenType close = open == LCUR ? RCUR : DEDENT;
+        int depth = 0;
+        int parens = 0; // ( and [
+        int braces = 0; // { in an indented body
+        for (int t = start; t < f->eof && parens >= 0 && braces >= 0; t++)
+        {
+            TokenType type = tokenType(f, t);
+            if (type == LPAR || type == LBRA)
+                parens++;
+            else if (type == RPAR || type == RBRA)
+                parens--;
+            else if (open == INDENT && type == LCUR)
+                braces++;
+            else if (open == INDENT && type == RCUR)
+                braces--;
+            else if (type == open)
+                depth++;
+            else if (type == close && --depth == 0)
+            {
+                if (parens != 0 || braces != 0)
+                    break;
+                setLazyBody(fun, start, t + 1);
+                f->tree->bodyTokens = f->tokenList;
+                f->current = t + 1;
+                *status = TRUE;
+                return NULL;
+            }
+            else if (startsTopLevelDeclaration(f, t))
+                break;
+        }
+    }
+    return compound_stmt(f, status);
+}
+
+void parseLazyBody(TreeNode *fun)
+{
+    int start, end;
+    if (!nodeLazyBody(fun, &start, &end))
+        return;
+    SyntaxTree *tree = treeOf(fun);
+    setLazyBody(fun, 0, 0); // 解析失败也只报告一次
+    ParserInfo f;
+    memset(&f, 0, sizeof(f));
+    f.tokenList = tree->bodyTokens;
+    f.current = start;
+    f.eof = end;
+    f.tree = tree;
+    Bool s;
+    TreeNode *body = compound_stmt(&f, &s);
+    if (s == TRUE)
+        setChild(fun, 1, body);
+}
+
+/*param-list --> param-list, param | param | void | empty*/
 TreeNode *param_list(ParserInfo *f, Bool *status)
 {
     Bool s;
+    int t = currentToken(f);
+    if (checkType(f, t, RPAR) || (checkType(f, t, VOID) && checkType(f, t + 1, RPAR)))
+    {
+        /* 没有参数：( ) 或 ( void )，由下一个 token 决定，不用先试 param() */
+        TreeNode *node = newNode(f->tree, PARAM_ND);
+        node->kind = VOID_PARAM;
+        node->type = VOID_TYPE;
+        node->lineNum = tokenLine(f, t);
+        checkMove(f, VOID);
+        *status = TRUE;
+        return node;
+    }
     TreeNode *firstParam = param(f, &s);
     if (s == FALSE)
     {
@@ -463,12 +1105,11 @@ TreeNode *param_list(ParserInfo *f, Bool *status)
         TreeNode *nextParam = param(f, &s);
         if (s == FALSE)
         {
-            fprintf(stderr, "Error: failed to parse parameter after ','.\n");
+            syntaxError(f, currentToken(f), "Invalid parameter after ','");
             *status = FALSE;
             return firstParam;
         }
-        currentNode->rSibling = nextParam;
-        nextParam->lSibling = currentNode;
+        setSibling(currentNode, nextParam);
         currentNode = nextParam;
     }
     *status = TRUE;
@@ -477,57 +1118,58 @@ TreeNode *param_list(ParserInfo *f, Bool *status)
 /*param --> type-specifier ID | type-specifier ID[] | ID*/
 TreeNode *param(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(PARAM_ND);
+    TreeMark mark = treeMark(f->tree);
+    TreeNode *node = newNode(f->tree, PARAM_ND);
     Bool s;
-    Token *typeToken = currentToken(f);
-    if (checkType(typeToken, INT) || checkType(typeToken, FRAC) || checkType(typeToken, VOID) || checkType(typeToken, STR))
+    int typeToken = currentToken(f);
+    if (checkType(f, typeToken, INT) || checkType(f, typeToken, FRAC) || checkType(f, typeToken, VOID) || checkType(f, typeToken, STR))
     {
-        switch (typeToken->type)
+        switch (tokenType(f, typeToken))
         {
         case INT:
-            node->attr.dclAttr.type = INT_TYPE;
+            node->type = INT_TYPE;
             break;
         case FRAC:
-            node->attr.dclAttr.type = FRAC_TYPE;
+            node->type = FRAC_TYPE;
             break;
         case VOID:
-            node->attr.dclAttr.type = VOID_TYPE;
+            node->type = VOID_TYPE;
             break;
         case STR:
-            node->attr.dclAttr.type = STR_TYPE;
+            node->type = STR_TYPE;
             break;
         default:
-            fprintf(stderr, "Unknown type in parameter declaration.\n");
+            syntaxError(f, typeToken, "Unknown type in parameter declaration");
             *status = FALSE;
-            removeNode(node);
+            treeRollback(f->tree, mark);
             return NULL;
         }
         moveTokenNext(f);
-        Token *idToken = currentToken(f);
+        int idToken = currentToken(f);
         if (checkMove(f, ID))
         {
-            node->attr.dclAttr.name = idToken->info;
-            if (checkType(currentToken(f), LBRA))
+            node->name = tokenName(f, idToken);
+            if (checkType(f, currentToken(f), LBRA))
             {
                 moveTokenNext(f);
-                if (checkType(currentToken(f), RBRA))
+                if (checkType(f, currentToken(f), RBRA))
                 {
-                    node->kind.param = ARRAY_PARAM;
+                    node->kind = ARRAY_PARAM;
                     moveTokenNext(f);
                     *status = TRUE;
                     return node;
                 }
                 else
                 {
-                    fprintf(stderr, "Error: Missing ']' in array parameter.\n");
+                    syntaxError(f, currentToken(f), "Missing ']' in array parameter");
                     *status = FALSE;
-                    removeNode(node);
+                    treeRollback(f->tree, mark);
                     return NULL;
                 }
             }
             else
             {
-                node->kind.param = VAR_PARAM;
+                node->kind = VAR_PARAM;
             }
             *status = TRUE;
             return node;
@@ -535,53 +1177,56 @@ TreeNode *param(ParserInfo *f, Bool *status)
     }
     else if (checkMove(f, ID))
     {
-        Token *idToken = currentToken(f);
-        node->attr.dclAttr.name = idToken->info;
-        node->attr.dclAttr.type = INT_TYPE;
-        node->kind.param = VAR_PARAM;
+        node->name = tokenName(f, typeToken);
+        node->type = INT_TYPE;
+        node->kind = VAR_PARAM;
         *status = TRUE;
         return node;
     }
-    printf("something wrong");
+    syntaxError(f, currentToken(f), "Expected a parameter, found '%s'", shownText(f, currentToken(f)));
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
-/*compound-stmt --> { local-declarations statement-list }*/
+/*compound-stmt --> { local-declarations statement-list } | INDENT local-declarations statement-list DEDENT*/
 TreeNode *compound_stmt(ParserInfo *f, Bool *status)
 {
+    TreeMark mark = treeMark(f->tree);
     TreeNode *root = NULL;
     Bool s;
-    if (!checkMove(f, LCUR))
+    TokenType close = RCUR; // 缩进块以 DEDENT 结束
+    if (checkType(f, currentToken(f), INDENT))
+        close = DEDENT;
+    if (!checkMove(f, close == RCUR ? LCUR : INDENT))
     {
-        fprintf(stderr, "Error: expected '{' at the start of compound statement.\n");
+        syntaxError(f, currentToken(f), "Expected '{' at the start of compound statement");
         *status = FALSE;
-        removeNode(root);
+        treeRollback(f->tree, mark);
         return NULL;
     }
-    root = newNode(STMT_ND);
-    root->kind.stmt = CMPD_STMT;
-    if ((root->child[0] = local_declarations(f, &s)), s == TRUE)
+    root = newNode(f->tree, STMT_ND);
+    root->kind = CMPD_STMT;
+    if ((setChild(root, 0, local_declarations(f, &s)), s == TRUE))
     {
-        if ((root->child[1] = statement_list(f, &s)), s == TRUE)
+        if ((setChild(root, 1, statement_list(f, &s)), s == TRUE))
         {
-            if (checkMove(f, RCUR))
+            if (checkMove(f, close))
             {
                 *status = TRUE;
                 return root;
             }
             else
             {
-                fprintf(stderr, "Error: expected '}' at the end of compound statement.\n");
+                syntaxError(f, currentToken(f), "Expected '%s' at the end of compound statement, found '%s'", close == RCUR ? "}" : "dedent", shownText(f, currentToken(f)));
                 *status = FALSE;
-                removeNode(root);
+                treeRollback(f->tree, mark);
                 return NULL;
             }
         }
     }
-    printf("something wrong");
+    syntaxError(f, currentToken(f), "Invalid compound statement at '%s'", shownText(f, currentToken(f)));
     *status = FALSE;
-    removeNode(root);
+    treeRollback(f->tree, mark);
     return NULL;
 }
 
@@ -591,13 +1236,13 @@ TreeNode *local_declarations(ParserInfo *f, Bool *status)
     TreeNode *head = NULL;
     TreeNode *tail = NULL;
 
-    while (canStartDeclaration(currentToken(f)->type))
+    while (isTypeSpecifier(tokenType(f, currentToken(f))))
     {
         Bool s;
         TreeNode *newNode = var_declaration(f, &s);
         if (s == FALSE)
         {
-            printf("Error: expected at least one declaration.\n");
+            syntaxError(f, currentToken(f), "Invalid local declaration");
             *status = FALSE;
             return head;
         }
@@ -608,8 +1253,7 @@ TreeNode *local_declarations(ParserInfo *f, Bool *status)
         }
         else
         {
-            tail->rSibling = newNode;
-            newNode->lSibling = tail;
+            setSibling(tail, newNode);
             tail = newNode;
         }
     }
@@ -625,12 +1269,17 @@ TreeNode *statement_list(ParserInfo *f, Bool *status)
     while (TRUE)
     {
         Bool s;
+        int t = currentToken(f);
+        if (t < 0 || checkType(f, t, RCUR) || checkType(f, t, DEDENT) || checkType(f, t, END_OF_FILE))
+            break; // 块结束：一次比较即可
+
         TreeNode *newNode = statement(f, &s);
         if (s == FALSE)
         {
-            printf("Error: expected at least one statement.\n");
-            *status = FALSE;
-            return head;
+            synchronizeStatement(f, t);
+            if (startsTopLevelDeclaration(f, currentToken(f)))
+                break; // 这个块没有结束，下一行已是顶层的声明
+            continue;
         }
         if (head == NULL)
         {
@@ -639,36 +1288,35 @@ TreeNode *statement_list(ParserInfo *f, Bool *status)
         }
         else
         {
-            tail->rSibling = newNode;
-            newNode->lSibling = tail;
+            setSibling(tail, newNode);
             tail = newNode;
         }
     }
     *status = TRUE;
     return head;
 }
-/*statement --> expression-stmt | compound-stmt | selection-stmt | iteration-stmt | return-stmt*/
+/*statement --> expression-stmt | compound-stmt (including an indented block) | selection-stmt | iteration-stmt | return-stmt*/
 TreeNode *statement(ParserInfo *f, Bool *status)
 {
     TreeNode *node = NULL;
     Bool s;
-    Token *t = currentToken(f);
-    if (!t)
+    int t = currentToken(f);
+    if (t < 0)
     {
         *status = FALSE;
         return NULL;
     }
-    if (checkType(t, LCUR))
+    if (checkType(f, t, LCUR) || checkType(f, t, INDENT))
         node = compound_stmt(f, &s);
-    else if (checkType(t, IF))
+    else if (checkType(f, t, IF))
     {
         node = selection_stmt(f, &s);
     }
-    else if (checkType(t, WHILE) || checkType(t, DO) || checkType(t, FOR))
+    else if (checkType(f, t, WHILE) || checkType(f, t, DO) || checkType(f, t, FOR))
     {
         node = iteration_stmt(f, &s);
     }
-    else if (checkType(t, RETURN))
+    else if (checkType(f, t, RETURN))
     {
         node = return_stmt(f, &s);
     }
@@ -682,12 +1330,13 @@ TreeNode *statement(ParserInfo *f, Bool *status)
 /*expression-stmt --> expression ; | ;*/
 TreeNode *expression_stmt(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(STMT_ND);
-    node->kind.stmt = EXPR_STMT;
-    node->lineNum = currentToken(f)->lineNum;
+    TreeMark mark = treeMark(f->tree);
+    TreeNode *node = newNode(f->tree, STMT_ND);
+    node->kind = EXPR_STMT;
+    node->lineNum = tokenLine(f, currentToken(f));
     node->type = VOID_TYPE;
     Bool s;
-    if (checkType(currentToken(f), SEMI))
+    if (checkType(f, currentToken(f), SEMI))
     {
         moveTokenNext(f);
         *status = TRUE;
@@ -695,7 +1344,7 @@ TreeNode *expression_stmt(ParserInfo *f, Bool *status)
     }
     else
     {
-        if ((node->child[0] = expression(f, &s)), s == TRUE)
+        if ((setChild(node, 0, expression(f, &s)), s == TRUE))
         {
             if (checkMove(f, SEMI))
             {
@@ -704,48 +1353,49 @@ TreeNode *expression_stmt(ParserInfo *f, Bool *status)
             }
         }
     }
-    printf("something wrong");
+    syntaxError(f, currentToken(f), "Expected ';' after expression, found '%s'", shownText(f, currentToken(f)));
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
 /*selection-stmt --> if ( expression ) statement | if ( expression ) statement else statement | if expression : statement | if expression : statement else : statement*/
 TreeNode *selection_stmt(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(STMT_ND);
+    TreeMark mark = treeMark(f->tree);
+    TreeNode *node = newNode(f->tree, STMT_ND);
     Bool s;
-    node->kind.stmt = SLCT_STMT;
-    node->lineNum = currentToken(f)->lineNum;
+    node->kind = SLCT_STMT;
+    node->lineNum = tokenLine(f, currentToken(f));
     if (!checkMove(f, IF))
     {
-        printf("missing if in selection statement");
+        syntaxError(f, currentToken(f), "Missing if in selection statement");
         *status = FALSE;
-        removeNode(node);
+        treeRollback(f->tree, mark);
         return NULL;
     }
 
-    Token *t = currentToken(f);
-    if (!t)
+    int t = currentToken(f);
+    if (t < 0)
     {
-        printf("unexpected end of tokens after 'if'");
-        removeNode(node);
+        syntaxError(f, currentToken(f), "Unexpected end of input after 'if'");
+        treeRollback(f->tree, mark);
         *status = FALSE;
         return NULL;
     }
 
-    if (checkType(t, LPAR))
+    if (checkType(f, t, LPAR))
     {
         moveTokenNext(f);
-        if (node->child[0] = expression(f, &s), s == TRUE)
+        if ((setChild(node, 0, expression(f, &s)), s == TRUE))
         {
             if (checkMove(f, RPAR))
             {
-                if (node->child[1] = statement(f, &s), s == TRUE)
+                if ((setChild(node, 1, statement(f, &s)), s == TRUE))
                 {
-                    if (checkType(currentToken(f), ELSE))
+                    if (checkType(f, currentToken(f), ELSE))
                     {
                         moveTokenNext(f);
-                        if (node->child[2] = statement(f, &s), s == TRUE)
+                        if ((setChild(node, 2, statement(f, &s)), s == TRUE))
                         {
                             *status = TRUE;
                             return node;
@@ -762,18 +1412,18 @@ TreeNode *selection_stmt(ParserInfo *f, Bool *status)
     }
     else
     {
-        if (node->child[0] = expression(f, &s), s == TRUE)
+        if ((setChild(node, 0, expression(f, &s)), s == TRUE))
         {
             if (checkMove(f, COLON))
             {
-                if (node->child[1] = statement(f, &s), s == TRUE)
+                if ((setChild(node, 1, statement(f, &s)), s == TRUE))
                 {
-                    if (checkType(currentToken(f), ELSE))
+                    if (checkType(f, currentToken(f), ELSE))
                     {
                         moveTokenNext(f);
                         if (checkMove(f, COLON))
                         {
-                            if (node->child[2] = statement(f, &s), s == TRUE)
+                            if ((setChild(node, 2, statement(f, &s)), s == TRUE))
                             {
                                 *status = TRUE;
                                 return node;
@@ -789,33 +1439,34 @@ TreeNode *selection_stmt(ParserInfo *f, Bool *status)
             }
         }
     }
-    printf("something wrong");
+    syntaxError(f, currentToken(f), "Invalid if statement at '%s'", shownText(f, currentToken(f)));
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
 /*iteration-stmt --> while expression : statement | while ( expression ) statement | do statement while (expression) | do: statement while expression | for（expression；expression；expression）statement ｜ for ID in expression : statement*/
 TreeNode *iteration_stmt(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(STMT_ND);
-    node->lineNum = currentToken(f)->lineNum; // 记录行号
+    TreeMark mark = treeMark(f->tree);
+    TreeNode *node = newNode(f->tree, STMT_ND);
+    node->lineNum = tokenLine(f, currentToken(f)); // 记录行号
     Bool s;
 
     /* ---------- WHILE 循环 ---------- */
-    if (checkType(currentToken(f), WHILE))
+    if (checkType(f, currentToken(f), WHILE))
     {
-        node->kind.stmt = WHILE_STMT;
+        node->kind = WHILE_STMT;
         moveTokenNext(f);
 
         // C风格：while ( condition ) { statement }
-        if (checkType(currentToken(f), LPAR))
+        if (checkType(f, currentToken(f), LPAR))
         {
             moveTokenNext(f);
-            if ((node->child[0] = expression(f, &s)), s == TRUE) // 条件表达式
+            if ((setChild(node, 0, expression(f, &s)), s == TRUE)) // 条件表达式
             {
                 if (checkMove(f, RPAR)) // 匹配右括号
                 {
-                    if ((node->child[1] = statement(f, &s)), s == TRUE) // 循环体
+                    if ((setChild(node, 1, statement(f, &s)), s == TRUE)) // 循环体
                     {
                         *status = TRUE;
                         return node;
@@ -824,11 +1475,11 @@ TreeNode *iteration_stmt(ParserInfo *f, Bool *status)
             }
         }
         // Python风格：while condition : statement
-        else if ((node->child[0] = expression(f, &s)), s == TRUE)
+        else if ((setChild(node, 0, expression(f, &s)), s == TRUE))
         {
             if (checkMove(f, COLON))
             {
-                if ((node->child[1] = statement(f, &s)), s == TRUE)
+                if ((setChild(node, 1, statement(f, &s)), s == TRUE))
                 {
                     *status = TRUE;
                     return node;
@@ -838,18 +1489,18 @@ TreeNode *iteration_stmt(ParserInfo *f, Bool *status)
     }
 
     /* ---------- DO-WHILE 循环 ---------- */
-    else if (checkType(currentToken(f), DO))
+    else if (checkType(f, currentToken(f), DO))
     {
-        node->kind.stmt = DO_WHILE_STMT;
+        node->kind = DO_WHILE_STMT;
         moveTokenNext(f);
 
-        if ((node->child[0] = statement(f, &s)), s == TRUE) // 循环体
+        if ((setChild(node, 0, statement(f, &s)), s == TRUE)) // 循环体
         {
             if (checkMove(f, WHILE))
             {
                 if (checkMove(f, LPAR))
                 {
-                    if ((node->child[1] = expression(f, &s)), s == TRUE) // 条件表达式
+                    if ((setChild(node, 1, expression(f, &s)), s == TRUE)) // 条件表达式
                     {
                         if (checkMove(f, RPAR))
                         {
@@ -863,49 +1514,53 @@ TreeNode *iteration_stmt(ParserInfo *f, Bool *status)
     }
 
     /* ---------- FOR 循环 ---------- */
-    else if (checkType(currentToken(f), FOR))
+    else if (checkType(f, currentToken(f), FOR))
     {
-        node->kind.stmt = FOR_STMT;
+        node->kind = FOR_STMT;
         moveTokenNext(f);
 
         // C风格：for (expr1; expr2; expr3) statement
         if (checkMove(f, LPAR))
         {
-            node->child[0] = expression(f, &s); // 初始化表达式
+            /* 三个表达式都可以省略：看到 ';' 或 ')' 就不去解析 */
+            if (!checkType(f, currentToken(f), SEMI) && (setChild(node, 0, expression(f, &s)), s == FALSE))
+                goto ERROR; // 初始化表达式
             if (!checkMove(f, SEMI))
                 goto ERROR;
 
-            node->child[1] = expression(f, &s); // 条件表达式
+            if (!checkType(f, currentToken(f), SEMI) && (setChild(node, 1, expression(f, &s)), s == FALSE))
+                goto ERROR; // 条件表达式
             if (!checkMove(f, SEMI))
                 goto ERROR;
 
-            node->child[2] = expression(f, &s); // 更新表达式
+            if (!checkType(f, currentToken(f), RPAR) && (setChild(node, 2, expression(f, &s)), s == FALSE))
+                goto ERROR; // 更新表达式
             if (!checkMove(f, RPAR))
                 goto ERROR;
 
-            if ((node->child[3] = statement(f, &s)), s == TRUE) // 循环体
+            if ((setChild(node, 3, statement(f, &s)), s == TRUE)) // 循环体
             {
                 *status = TRUE;
                 return node;
             }
         }
         // Python风格：for ID in expression : statement
-        else if (checkType(currentToken(f), ID))
+        else if (checkType(f, currentToken(f), ID))
         {
-            TreeNode *iterVar = newNode(EXPR_ND); // 迭代变量
-            iterVar->kind.expr = ID_EXPR;
-            iterVar->attr.exprAttr.name = currentToken(f)->info;
-            iterVar->lineNum = currentToken(f)->lineNum;
-            node->child[0] = iterVar;
+            TreeNode *iterVar = newNode(f->tree, EXPR_ND); // 迭代变量
+            iterVar->kind = ID_EXPR;
+            iterVar->name = tokenName(f, currentToken(f));
+            iterVar->lineNum = tokenLine(f, currentToken(f));
+            setChild(node, 0, iterVar);
             moveTokenNext(f);
 
             if (checkMove(f, IN)) // 匹配 `in`
             {
-                if ((node->child[1] = expression(f, &s)), s == TRUE) // 迭代对象
+                if ((setChild(node, 1, expression(f, &s)), s == TRUE)) // 迭代对象
                 {
                     if (checkMove(f, COLON))
                     {
-                        if ((node->child[2] = statement(f, &s)), s == TRUE) // 循环体
+                        if ((setChild(node, 2, statement(f, &s)), s == TRUE)) // 循环体
                         {
                             *status = TRUE;
                             return node;
@@ -917,24 +1572,25 @@ TreeNode *iteration_stmt(ParserInfo *f, Bool *status)
     }
 
 ERROR:
-    printf("Error: Invalid iteration statement.\n");
+    syntaxError(f, currentToken(f), "Invalid iteration statement at '%s'", shownText(f, currentToken(f)));
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
 /*return-stmt --> return expression ; | return ;*/
 TreeNode *return_stmt(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(STMT_ND);
-    node->kind.stmt = RTN_STMT;               // 标记为 return 语句
-    node->lineNum = currentToken(f)->lineNum; // 记录行号
+    TreeMark mark = treeMark(f->tree);
+    TreeNode *node = newNode(f->tree, STMT_ND);
+    node->kind = RTN_STMT; // 标记为 return 语句
+    node->lineNum = tokenLine(f, currentToken(f)); // 记录行号
     Bool s;
 
     // 匹配 "return" 关键字
     if (checkMove(f, RETURN))
     {
         // 情况 1：无返回值的 return;
-        if (checkType(currentToken(f), SEMI))
+        if (checkType(f, currentToken(f), SEMI))
         {
             moveTokenNext(f); // 消耗 ";"
             *status = TRUE;
@@ -943,7 +1599,7 @@ TreeNode *return_stmt(ParserInfo *f, Bool *status)
         else
         {
             // 情况 2：有返回值的 return expression;
-            if ((node->child[0] = expression(f, &s)), s == TRUE)
+            if ((setChild(node, 0, expression(f, &s)), s == TRUE))
             {
                 if (checkMove(f, SEMI)) // 检查 ";"
                 {
@@ -955,59 +1611,129 @@ TreeNode *return_stmt(ParserInfo *f, Bool *status)
     }
 
     // 如果上述条件都不满足，说明语法有误
-    printf("Syntax error: Invalid return statement\n");
+    syntaxError(f, currentToken(f), "Invalid return statement at '%s'", shownText(f, currentToken(f)));
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
-/*expression --> var = expression | simple-expression*/
+/* Binding power of the operators, weakest first. expression() is a Pratt
+   parser: one loop climbs this table instead of one function per level,
+   and each operator makes exactly one node. */
+enum
+{
+    PREC_NONE,    // not a binary operator
+    PREC_ASSIGN,  // = += -= *= /= %= **=  (right to left)
+    PREC_OR,      // ||
+    PREC_AND,     // &&
+    PREC_BIT_OR,  // |
+    PREC_BIT_AND, // &
+    PREC_EQUAL,   // == !=
+    PREC_COMPARE, // < > <= >=
+    PREC_SHIFT,   // << >>
+    PREC_ADD,     // + -
+    PREC_MUL,     // * / %
+    PREC_PREFIX,  // - ! in front of an operand
+    PREC_POWER    // **  (right to left; -a ** b is -(a ** b))
+};
+
+static const unsigned char binaryPrecedence[TOKEN_COUNT] = {
+    [ASSIGN] = PREC_ASSIGN,
+    [PLUS_ASSIGN] = PREC_ASSIGN,
+    [MINUS_ASSIGN] = PREC_ASSIGN,
+    [MUL_ASSIGN] = PREC_ASSIGN,
+    [DIV_ASSIGN] = PREC_ASSIGN,
+    [MOD_ASSIGN] = PREC_ASSIGN,
+    [POWER_ASSIGN] = PREC_ASSIGN,
+    [OR] = PREC_OR,
+    [AAND] = PREC_AND,
+    [OR1] = PREC_BIT_OR,
+    [AND] = PREC_BIT_AND,
+    [EQ] = PREC_EQUAL,
+    [UNEQ] = PREC_EQUAL,
+    [LT] = PREC_COMPARE,
+    [GT] = PREC_COMPARE,
+    [LTE] = PREC_COMPARE,
+    [GTE] = PREC_COMPARE,
+    [LEFT_SHIFT] = PREC_SHIFT,
+    [RIGHT_SHIFT] = PREC_SHIFT,
+    [PLUS] = PREC_ADD,
+    [MINUS] = PREC_ADD,
+    [MUL] = PREC_MUL,
+    [DIV] = PREC_MUL,
+    [MOD] = PREC_MUL,
+    [POWER] = PREC_POWER,
+};
+
+/*expression --> var assignop expression | expression binop expression | factor
+  assignop --> = | += | -= | *= | /= | %= | **=
+  binop --> || | && | | | & | == | != | < | > | <= | >= | << | >> | + | - | * | / | % | ** */
 TreeNode *expression(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(EXPR_ND);
-
+    return binary_expression(f, PREC_ASSIGN, status);
+}
+/* binary_expression()
+   An operand followed by every operator that binds at least as tightly as
+   minPrecedence, with its right operand. The tree comes out grouped by
+   precedence: a + b * c is +(a, *(b, c)). */
+TreeNode *binary_expression(ParserInfo *f, int minPrecedence, Bool *status)
+{
+    TreeMark mark = treeMark(f->tree);
     Bool s;
-    if (node->child[0] = var(f, &s), s == TRUE)
+    TreeNode *left = factor(f, &s);
+    if (s == FALSE)
     {
-
-        if (checkMove(f, ASSIGN))
-        {
-            node->kind.expr = ASN_EXPR;
-            if (node->child[1] = expression(f, &s), s == TRUE)
-            {
-                *status = TRUE;
-                return node;
-            }
-        }
+        *status = FALSE;
+        return NULL;
     }
-    else
+    while (TRUE)
     {
-        if (node->child[0] = simple_expression(f, &s), s == TRUE)
+        int t = currentToken(f);
+        TokenType op = tokenType(f, t);
+        int prec = binaryPrecedence[op];
+        if (prec == PREC_NONE || prec < minPrecedence)
+            break;
+        if (prec == PREC_ASSIGN && left->kind != ID_EXPR && left->kind != ARRAY_EXPR)
         {
-            node->kind.expr = OP_EXPR;
-            *status = TRUE;
-            return node;
+            syntaxError(f, t, "Left side of '%s' is not a variable", shownText(f, t));
+            break;
+        }
+        TreeNode *node = newNode(f->tree, EXPR_ND);
+        node->kind = prec == PREC_ASSIGN ? ASN_EXPR : OP_EXPR;
+        node->op = op;
+        node->lineNum = tokenLine(f, t);
+        setChild(node, 0, left);
+        moveTokenNext(f);
+        /* a right-to-left operator takes its own level again on the right */
+        int next = (prec == PREC_ASSIGN || prec == PREC_POWER) ? prec : prec + 1;
+        if ((setChild(node, 1, binary_expression(f, next, &s)), s == FALSE))
+        {
+            syntaxError(f, t, "Missing operand after '%s'", shownText(f, t));
+            *status = FALSE;
+            treeRollback(f->tree, mark);
+            return NULL;
         }
+        left = node;
     }
-    printf("something wrong");
-    *status = FALSE;
-    removeNode(node);
-    return NULL;
+    *status = TRUE;
+    return left;
 }
 /*var --> ID | ID [ expression ]*/
 TreeNode *var(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(EXPR_ND);
-    node->lineNum = currentToken(f)->lineNum;
+    TreeMark mark = treeMark(f->tree);
+    TreeNode *node = newNode(f->tree, EXPR_ND);
+    int t = currentToken(f);
+    node->lineNum = tokenLine(f, t);
     Bool s;
     if (checkMove(f, ID))
     {
-        node->kind.expr = ID_EXPR;
-        node->attr.exprAttr.name = currentToken(f)->info;
-        if (checkType(currentToken(f), LBRA))
+        node->kind = ID_EXPR;
+        node->name = tokenName(f, t);
+        if (checkType(f, currentToken(f), LBRA))
         {
             moveTokenNext(f);
-            node->kind.expr = ARRAY_EXPR;
-            if (node->child[0] = expression(f, &s), s == TRUE)
+            node->kind = ARRAY_EXPR;
+            if ((setChild(node, 0, expression(f, &s)), s == TRUE))
             {
                 if (checkMove(f, RBRA))
                 {
@@ -1015,230 +1741,36 @@ TreeNode *var(ParserInfo *f, Bool *status)
                     return node;
                 }
             }
-            printf("Syntax error: Incomplete array access\n");
+            syntaxError(f, currentToken(f), "Incomplete array access");
             *status = FALSE;
-            removeNode(node);
+            treeRollback(f->tree, mark);
             return NULL;
         }
         *status = TRUE;
         return node;
     }
-    printf("Syntax error: Expected variable identifier\n");
+    syntaxError(f, currentToken(f), "Expected variable identifier");
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
-/*simple-expression --> additive-expression relop additive-expression | additive-expression*/
-TreeNode *simple_expression(ParserInfo *f, Bool *status)
-{
-    TreeNode *node = newNode(EXPR_ND);
-    node->lineNum = currentToken(f)->lineNum;
-    Bool s;
-    if (node->child[0] = additive_expression(f, &s), s == TRUE)
-    {
-        if (node->child[1] = relop(f, &s), s == TRUE)
-        {
-            node->kind.expr = OP_EXPR;
-            node->attr.exprAttr.op = currentToken(f)->type;
-            if (node->child[2] = additive_expression(f, &s), s == TRUE)
-            {
-                *status = TRUE;
-                return node;
-            }
-            else
-            {
-                printf("Error: Invalid right-hand side in relational expression.\n");
-                *status = FALSE;
-                removeNode(node);
-                return NULL;
-            }
-        }
-        node->kind.expr = OP_EXPR;
-        *status = TRUE;
-        return node;
-    }
-    printf("Error: Invalid simple expression.\n");
-    *status = FALSE;
-    removeNode(node);
-    return NULL;
-}
-/*relop --> < | <= | > | >= | == | !=*/
-TreeNode *relop(ParserInfo *f, Bool *status)
-{
-    TreeNode *node = newNode(EXPR_ND);
-    node->lineNum = currentToken(f)->lineNum;
-    Bool s;
-    Token *t = currentToken(f);
-    if (checkMove(f, LT) || checkMove(f, LTE) || checkMove(f, GT) || checkMove(f, GTE) || checkMove(f, EQ) || checkMove(f, UNEQ))
-    {
-        node->kind.expr = OP_EXPR;
-        node->attr.exprAttr.op = t->type;
-        *status = TRUE;
-        return node;
-    }
-    printf("Error: Expected relational operator.\n");
-    *status = FALSE;
-    removeNode(node);
-    return NULL;
-}
-/*additive-expression --> additive-expression addop term | term*/
-TreeNode *additive_expression(ParserInfo *f, Bool *status)
-{
-    Bool s;
-    TreeNode *root = NULL;
-    TreeNode *t = term(f, &s);
-    if (s == FALSE)
-    {
-        *status = FALSE;
-        return NULL;
-    }
-    root = t;
-    while (5 == 5)
-    {
-        TokenType tp = currentToken(f)->type;
-        if (tp == PLUS || tp == MINUS)
-        {
-            TreeNode *newRoot = newNode(EXPR_ND);
-            newRoot->kind.expr = OP_EXPR;
-            newRoot->lineNum = currentToken(f)->lineNum;
-            newRoot->attr.exprAttr.op = tp;
-            newRoot->child[0] = root;
-            moveTokenNext(f);
-            newRoot->child[1] = term(f, &s);
-
-            if (s == FALSE)
-            {
-                printf("Error: invalid term after '+' or '-'\n");
-                *status = FALSE;
-                removeNode(newRoot);
-                return NULL;
-            }
-            root = newRoot;
-        }
-        else
-        {
-            break;
-        }
-    }
-    *status = TRUE;
-    return root;
-}
-/*addop --> + | -*/
-TreeNode *addop(ParserInfo *f, Bool *status)
-{
-    TreeNode *node = newNode(EXPR_ND);
-    node->kind.expr = OP_EXPR;
-    node->lineNum = currentToken(f)->lineNum;
-    TokenType tp = currentToken(f)->type;
-    if (tp == PLUS || tp == MINUS)
-    {
-        node->attr.exprAttr.op = tp; // 记录操作符类型
-        moveTokenNext(f);            // 成功匹配，移动到下一个 Token
-        *status = TRUE;
-        return node;
-    }
-
-    // 如果不是 + 或 -，报错并释放节点
-    printf("Syntax Error: expected '+' or '-', but got token type %d\n", tp);
-    *status = FALSE;
-    removeNode(node);
-    return NULL;
-}
-/*term --> term mulop factor | factor*/
-
-TreeNode *term(ParserInfo *f, Bool *status)
-{
-    Bool s;
-    TreeNode *root = NULL;
-
-    // 1. 解析第一个 factor
-    TreeNode *t = factor(f, &s);
-    if (s == FALSE)
-    {
-        *status = FALSE;
-        return NULL;
-    }
-    root = t;
-
-    // 2. 处理连续的 * 或 / 运算
-    while (TRUE)
-    {
-        TokenType tp = currentToken(f)->type;
-
-        if (tp == MUL || tp == DIV)
-        {
-            // 创建新的操作符节点
-            TreeNode *newRoot = newNode(EXPR_ND);
-            newRoot->kind.expr = OP_EXPR;                // 标记为运算符节点
-            newRoot->lineNum = currentToken(f)->lineNum; // 保存行号
-            newRoot->attr.exprAttr.op = tp;              // 保存操作符（* 或 /）
-
-            // 左子树指向当前根
-            newRoot->child[0] = root;
-
-            // 移动到下一个 token，并解析右侧 factor
-            moveTokenNext(f);
-            newRoot->child[1] = factor(f, &s);
-
-            if (s == FALSE)
-            {
-                printf("Error: invalid factor after '*' or '/'\n");
-                removeNode(newRoot);
-                *status = FALSE;
-                return NULL;
-            }
-
-            // 更新根节点
-            root = newRoot;
-        }
-        else
-        {
-            break; // 不是 * 或 /，退出循环
-        }
-    }
-
-    *status = TRUE;
-    return root;
-}
-
-/*mulop --> * | / */
-TreeNode *mulop(ParserInfo *f, Bool *status)
-{
-    TreeNode *node = newNode(EXPR_ND);
-    node->kind.expr = OP_EXPR;
-    node->lineNum = currentToken(f)->lineNum;
-
-    TokenType tp = currentToken(f)->type;
-    Bool s;
-    if (tp == MUL || tp == DIV)
-    {
-        node->attr.exprAttr.op = tp; // 记录操作符类型 (* 或 /)
-        moveTokenNext(f);            // 匹配成功，移动到下一个 Token
-        *status = TRUE;
-        return node;
-    }
-
-    // 错误处理：不是 * 或 / 则报错
-    printf("Syntax Error: expected '*' or '/', but got token type %d\n", tp);
-    *status = FALSE;
-    removeNode(node); // 释放节点，防止内存泄漏
-    return NULL;
-}
-/* factor --> ( expression ) | var | call | NUM | STR */
+/* factor --> ( expression ) | var | call | NUM | STR | - factor | ! factor
+            | ++ var | -- var | var ++ | var -- */
 TreeNode *factor(ParserInfo *f, Bool *status)
 {
+    TreeMark mark = treeMark(f->tree);
     TreeNode *node = NULL;
     Bool s;
 
-    Token *t = currentToken(f);
-    if (!t)
+    int t = currentToken(f);
+    if (t < 0)
     {
-        printf("Syntax Error: Unexpected end of input in factor.\n");
+        syntaxError(f, t, "Unexpected end of input in factor");
         *status = FALSE;
         return NULL;
     }
 
-    switch (t->type)
+    switch (tokenType(f, t))
     {
     case LPAR:            // ( expression )
         moveTokenNext(f); // Consume '('
@@ -1252,18 +1784,64 @@ TreeNode *factor(ParserInfo *f, Bool *status)
             }
             else
             {
-                printf("Syntax Error: Expected ')' after expression.\n");
+                syntaxError(f, currentToken(f), "Expected ')' after expression, found '%s'", shownText(f, currentToken(f)));
             }
         }
         break;
 
-    case ID: // var or call
-        // 先尝试解析为函数调用
-        node = call(f, &s);
-        if (s == FALSE)
+    case MINUS: // 一元运算符：只有 child[0]
+    case NOT:
+        node = newNode(f->tree, EXPR_ND);
+        node->kind = OP_EXPR;
+        node->op = tokenType(f, t);
+        node->lineNum = tokenLine(f, t);
+        moveTokenNext(f);
+        if ((setChild(node, 0, binary_expression(f, PREC_PREFIX, &s)), s == TRUE))
+        {
+            *status = TRUE;
+            return node;
+        }
+        break;
+
+    case PPLUS: // 前置自增、自减：只有 child[0]，必须是变量
+    case MMINUS:
+        node = newNode(f->tree, EXPR_ND);
+        node->kind = OP_EXPR;
+        node->op = tokenType(f, t);
+        node->lineNum = tokenLine(f, t);
+        moveTokenNext(f);
+        if (!checkType(f, currentToken(f), ID) || checkType(f, currentToken(f) + 1, LPAR))
+        {
+            syntaxError(f, currentToken(f), "Operand of '%s' is not a variable", shownText(f, t));
+            break;
+        }
+        if ((setChild(node, 0, var(f, &s)), s == TRUE))
+        {
+            *status = TRUE;
+            return node;
+        }
+        break;
+
+    case ID: // var or call: 看下一个 token 是不是 '('
+        if (checkType(f, t + 1, LPAR))
+        {
+            node = call(f, &s);
+        }
+        else
         {
-            // 失败则尝试解析为变量
             node = var(f, &s);
+            int u = currentToken(f);
+            if (s == TRUE && (checkType(f, u, PPLUS) || checkType(f, u, MMINUS)))
+            {
+                TreeNode *operand = node; // 后置自增、自减：extra 为 1
+                node = newNode(f->tree, EXPR_ND);
+                node->kind = OP_EXPR;
+                node->op = tokenType(f, u);
+                node->lineNum = tokenLine(f, u);
+                node->extra = 1;
+                setChild(node, 0, operand);
+                moveTokenNext(f);
+            }
         }
         if (s == TRUE)
         {
@@ -1292,160 +1870,157 @@ TreeNode *factor(ParserInfo *f, Bool *status)
         break;
 
     default:
-        printf("Syntax Error: Unexpected token '%s' in factor.\n", t->info);
+        syntaxError(f, t, "Unexpected token '%s' in factor", shownText(f, t));
         break;
     }
 
     // 错误处理
-    if (node)
-    {
-        removeNode(node);
-    }
+    treeRollback(f->tree, mark);
     *status = FALSE;
     return NULL;
 }
 /* num --> INTL | FRACL */
 TreeNode *num(ParserInfo *f, Bool *status)
 {
-    Token *t = currentToken(f); // 获取当前 Token
-    if (!t)
+    TreeMark mark = treeMark(f->tree);
+    int t = currentToken(f); // 获取当前 Token
+    if (t < 0)
     {
-        printf("Syntax Error: Unexpected end of input in num.\n");
+        syntaxError(f, t, "Unexpected end of input in num");
         *status = FALSE;
         return NULL;
     }
 
     // 创建新节点
-    TreeNode *node = newNode(EXPR_ND);
-    node->lineNum = t->lineNum;
-    node->kind.expr = CONST_EXPR; // 常量表达式
+    TreeNode *node = newNode(f->tree, EXPR_ND);
+    node->lineNum = tokenLine(f, t);
+    node->kind = CONST_EXPR; // 常量表达式
 
     if (checkMove(f, INTL)) // 处理整数常量
     {
         node->type = INT_TYPE;                   // 设置类型为整数
-        node->attr.exprAttr.val = atoi(t->info); // 将字符串转换成整数
+        setConstant(node, tokenNumber(f, t)); // 扫描器已算好的值，n / 1
         *status = TRUE;
         return node;
     }
-    else if (checkMove(f, FRACL)) // 处理浮点数常量
+    else if (checkMove(f, FRACL)) // 处理分数常量
     {
-        node->type = FRAC_TYPE;                  // 设置类型为浮点数
-        node->attr.exprAttr.val = atof(t->info); // 将字符串转换成浮点数
+        node->type = FRAC_TYPE;                  // 设置类型为分数
+        setConstant(node, tokenNumber(f, t)); // 约分后的分子/分母，没有舍入
         *status = TRUE;
         return node;
     }
 
     // 错误处理：既不是 INTL 也不是 FRACL
-    printf("Syntax Error: Expected INTL or FRACL but got '%s'\n", t->info);
+    syntaxError(f, t, "Expected INTL or FRACL but got '%s'", shownText(f, t));
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
 /* Str --> STRL */
 TreeNode *Str(ParserInfo *f, Bool *status)
 {
-    Token *t = currentToken(f); // 获取当前 Token
-    if (!t)
+    TreeMark mark = treeMark(f->tree);
+    int t = currentToken(f); // 获取当前 Token
+    if (t < 0)
     {
-        printf("Syntax Error: Unexpected end of input in string literal.\n");
+        syntaxError(f, t, "Unexpected end of input in string literal");
         *status = FALSE;
         return NULL;
     }
 
     // 创建新的表达式节点
-    TreeNode *node = newNode(EXPR_ND);
-    node->lineNum = t->lineNum;   // 记录行号
-    node->kind.expr = CONST_EXPR; // 设置为常量表达式
+    TreeNode *node = newNode(f->tree, EXPR_ND);
+    node->lineNum = tokenLine(f, t);   // 记录行号
+    node->kind = CONST_EXPR; // 设置为常量表达式
     node->type = STR_TYPE;        // 设置表达式类型为字符串
 
     // 匹配字符串字面量
     if (checkMove(f, STRL))
     {
-        node->attr.exprAttr.name = strdup(t->info); // 保存字符串内容
+        if (f->quiet)
+            node->extra = (unsigned)t; // interned later, see internStrings()
+        else
+            node->name = internString(tokenText(f, t)); // 字符串内容也放进标识符池
         *status = TRUE;
         return node;
     }
 
     // 错误处理
-    printf("Syntax Error: Expected string literal (STRL), but got '%s'\n", t->info);
+    syntaxError(f, t, "Expected string literal (STRL), but got '%s'", shownText(f, t));
     *status = FALSE;
-    removeNode(node);
+    treeRollback(f->tree, mark);
     return NULL;
 }
 /* call --> ID ( args ) */
 TreeNode *call(ParserInfo *f, Bool *status)
 {
-    Token *t = currentToken(f); // 获取当前Token
-    if (!t || !checkType(t, ID))
+    TreeMark mark = treeMark(f->tree);
+    int t = currentToken(f); // 获取当前Token
+    if (!checkType(f, t, ID))
     {
-        printf("Syntax Error: Expected function name (ID) at line %d.\n", t ? t->lineNum : -1);
+        syntaxError(f, t, "Expected function name (ID)");
         *status = FALSE;
         return NULL;
     }
 
     // 创建函数调用节点
-    TreeNode *node = newNode(EXPR_ND);
-    node->kind.expr = CALL_EXPR;                // 设置节点类型为函数调用
-    node->lineNum = t->lineNum;                 // 记录行号
-    node->attr.exprAttr.name = strdup(t->info); // 保存函数名称
+    TreeNode *node = newNode(f->tree, EXPR_ND);
+    node->kind = CALL_EXPR; // 设置节点类型为函数调用
+    node->lineNum = tokenLine(f, t);                 // 记录行号
+    node->name = tokenName(f, t); // 保存函数名称
 
     moveTokenNext(f); // 消耗 ID
 
     // 匹配左括号 '('
     if (!checkMove(f, LPAR))
     {
-        printf("Syntax Error: Expected '(' after function name '%s' at line %d.\n", t->info, t->lineNum);
+        syntaxError(f, t, "Expected '(' after function name '%s'", tokenText(f, t));
         *status = FALSE;
-        removeNode(node);
+        treeRollback(f->tree, mark);
         return NULL;
     }
 
     // 解析参数列表
     Bool s;
-    node->child[0] = args(f, &s);
+    setChild(node, 0, args(f, &s));
     if (s == FALSE)
     {
-        printf("Syntax Error: Invalid argument list in function call '%s' at line %d.\n", t->info, t->lineNum);
+        syntaxError(f, t, "Invalid argument list in function call '%s'", tokenText(f, t));
         *status = FALSE;
-        removeNode(node);
+        treeRollback(f->tree, mark);
         return NULL;
     }
 
     // 匹配右括号 ')'
     if (!checkMove(f, RPAR))
     {
-        printf("Syntax Error: Expected ')' after arguments in function call '%s' at line %d.\n", t->info, t->lineNum);
+        syntaxError(f, currentToken(f), "Expected ')' after arguments in function call '%s'", tokenText(f, t));
         *status = FALSE;
-        removeNode(node);
+        treeRollback(f->tree, mark);
         return NULL;
     }
 
     *status = TRUE;
     return node;
 }
-/* args --> arg-list | empty */
+/* args --> arg-list | empty
+   The arguments hang directly under the CALL_EXPR as child[0] and its
+   siblings; NULL for an empty list. */
 TreeNode *args(ParserInfo *f, Bool *status)
 {
-    TreeNode *node = newNode(EXPR_ND); // 参数是表达式，节点类型改为 EXPR_ND
-    node->kind.expr = CALL_EXPR;       // 设置节点为函数调用参数
-    node->lineNum = currentToken(f)->lineNum;
-
-    Bool s;
-    node->child[0] = arg_list(f, &s); // 尝试解析参数列表
-
-    if (s == TRUE)
+    // 参数为空：下一个就是 ')'
+    if (checkType(f, currentToken(f), RPAR))
     {
         *status = TRUE;
-        return node;
+        return NULL;
     }
-
-    // 如果参数为空，直接返回空的 ARGS 节点
-    *status = TRUE;
-    return node;
+    return arg_list(f, status);
 }
 /* arg-list --> arg-list , expression | expression */
 TreeNode *arg_list(ParserInfo *f, Bool *status)
 {
+    TreeMark mark = treeMark(f->tree);
     Bool s;
     TreeNode *head = NULL;
     TreeNode *tail = NULL;
@@ -1454,7 +2029,7 @@ TreeNode *arg_list(ParserInfo *f, Bool *status)
     TreeNode *expr = expression(f, &s);
     if (s == FALSE)
     {
-        printf("Syntax Error: Failed to parse the first argument expression at line %d.\n", currentToken(f)->lineNum);
+        syntaxError(f, currentToken(f), "Invalid first argument");
         *status = FALSE;
         return NULL;
     }
@@ -1463,22 +2038,21 @@ TreeNode *arg_list(ParserInfo *f, Bool *status)
     tail = expr;
 
     // 解析后续的逗号分隔的参数
-    while (checkType(currentToken(f), COMMA))
+    while (checkType(f, currentToken(f), COMMA))
     {
         moveTokenNext(f); // 消耗逗号
 
         expr = expression(f, &s);
         if (s == FALSE)
         {
-            printf("Syntax Error: Failed to parse argument after ',' at line %d.\n", currentToken(f)->lineNum);
+            syntaxError(f, currentToken(f), "Invalid argument after ','");
             *status = FALSE;
-            removeNode(head); // 释放之前成功解析的节点
+            treeRollback(f->tree, mark); // 释放之前成功解析的节点
             return NULL;
         }
 
         // 将新解析的参数挂到兄弟节点上
-        tail->rSibling = expr;
-        expr->lSibling = tail;
+        setSibling(tail, expr);
         tail = expr;
     }
 
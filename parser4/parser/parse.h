@@ -90,64 +90,130 @@ typedef enum
 /***********   Syntax tree for parsing ************/
 /************************** ************************/
 
-struct someStructWithType
-{
-  int type;
-  void *something;
-};
-struct exprAttr
-{
-  TokenType op;     // used by Op_EXPR
-  int val;          // used by Const_EXPR,
-  const char *name; // used by ID_EXPR, Call_EXPR, Array_EXPR
-  struct someStructWithType *exprAttr;
-};
+/* The syntax tree is index based: a node names its children, siblings
+   and parent by 32-bit NodeIds into the node array of its tree, and keeps
+   only the fields every node needs. What few nodes need lives in side
+   tables of the tree: the value of a number constant, the size of an
+   array and the scope of a function (TreeNode.extra indexes them), and
+   the symbol table links (by NodeId, made on first use). Go through the
+   accessors below rather than the raw ids. */
+typedef unsigned NodeId; // index in the node array of a tree
+#define NO_NODE 0        // no node; never a real node
+
 typedef struct treeNode
 {
-  struct treeNode *child[MAX_CHILDREN]; // children of the node
-  struct treeNode *lSibling;            // left sibling
-  struct treeNode *rSibling;            // right sibling
-  // sibling is useful for declaration_list, param_list, local_declarations, statement_list, arg_list.
-  struct treeNode *parent; // parent of the node
-  /* parent is useful to check the containing structure of a node during parsing. So, the connected tree nodes can be found in all directions, up (to parents), down (to children), and horizontally (left and right to siblings).  */
+  unsigned char nodeKind; // 节点的分类（大类）NodeKind
+  unsigned char kind;     // 小类：DclKind, ParamKind, StmtKind or ExprKind, as nodeKind says
+  unsigned char type;     // ExprType: the declared type of a DCL or PARAM; of an expression, set by the type checker
+  unsigned char op;       // TokenType of the operator of an OP_EXPR
   /* LineNum:  At the momemt in parsing, when this treeNode is constructed, what is the line number of the token being handled. */
   int lineNum;
-  NodeKind nodeKind; // 节点的分类（大类）
-  union
-  {
-    DclKind dcl;
-    ParamKind param;
-    StmtKind stmt;
-    ExprKind expr;
-  } kind; // 小类
-  union
-  {
-    union
-    {
-      TokenType op; // used by Op_EXPR
-      int val;      // used by Const_EXPR,
-      const char *name;
-      Token *token; // used by ID_EXPR, Call_EXPR, Array_EXPR
-      ExprType type;
-    } exprAttr;
-    struct
-    {                           // it is a struct, not union, because an array declaration need all the three fields.
-      ExprType type;            // used by all dcl and param
-      const char *name;         // used by all dcl and param
-      int size;                 // used by array declaration
-      char initValue;           // used by array declaration
-      struct exprAttr exprAttr; // used by variable declaration
-      SymbolTable *symbol;
-      Token *token; // used by variable declaration
-      /* size is only used for and array declaration; i.e., when  Dcl_Kind is Array_DCL. The requirement that size must be a constant should be checked by semantic analyzer.   For parameters, for Array_PARAM, size is ignored. For array element argument, the index is a child of the node, and should not be considered as dclAttr. */
-    } dclAttr; // for declaration and parameters.
-  } attr;
-  ExprType type;
-
-  /* type is for type-checking of exps, will be updated by type-checker,  the parser does not touch it.  */
-  void *something; // can carry something possibly useful for other tasks of compiling
+  NodeId self;     // own id; leads to the tree (see treeOf())
+  NodeId parent;
+  NodeId lSibling;
+  NodeId rSibling; // siblings chain declaration_list, param_list, local_declarations, statement_list, arg_list
+  NodeId child[MAX_CHILDREN];
+  Symbol name;     // DCL, PARAM, ID_EXPR, ARRAY_EXPR, CALL_EXPR, and the text of a string CONST_EXPR
+  unsigned extra;  // number CONST_EXPR: index of its value; ARRAY_DCL, FUN_DCL: index of its DclInfo; ++ or -- OP_EXPR: 1 if after its operand
 } TreeNode;
 
+/* Side table entry of an array or function declaration */
+typedef struct dclInfo
+{
+  int size;            // ARRAY_DCL: number of elements
+  SymbolTable *symbol; // FUN_DCL: the scope of the body, set by the analyzer
+  int bodyStart;       // FUN_DCL: a body not parsed yet is tokens [bodyStart, bodyEnd) of bodyTokens
+  int bodyEnd;         // 0 once it is parsed
+} DclInfo;
+
+/* Nodes are allocated a page at a time from the tree's arena, so a node
+   never moves and a TreeNode * stays valid as the tree grows. Slot i of a
+   page holds node (page << NODE_PAGE_BITS) + i; id 0 is never handed out. */
+#define NODE_PAGE_BITS 8
+#define NODE_PAGE_SIZE (1 << NODE_PAGE_BITS)
+
+typedef struct nodePage
+{
+  struct syntaxTree *tree;
+  TreeNode node[NODE_PAGE_SIZE];
+} NodePage;
+
+/* Everything, the header included, comes from one arena: free_tree()
+   gives back the whole tree at once. */
+typedef struct syntaxTree
+{
+  Arena arena;
+  NodePage **page;
+  int pageCount;
+  int pageCapacity;
+  NodeId nodeCount;  // ids below this are in use
+  Rational *constant;
+  int constantCount;
+  int constantCapacity;
+  DclInfo *dcl;
+  int dclCount;
+  int dclCapacity;
+  void **something;  // by NodeId, NULL until first set; see symbol_table.c
+  NodeId somethingCapacity;
+  NodeId rolledBack; // nodes given back by treeRollback(): parse work thrown away
+  NodeId replaced;   // nodes reparseEdit() took out of the tree; their ids stay in use
+  List *bodyTokens;  // the token list of the lazy function bodies: see setLazyBodies()
+  int pendingBodies; // lazy bodies not parsed yet (no fewer than that)
+} SyntaxTree;
+
+/* A failed parse attempt gives back the nodes it made by rolling the tree
+   back to a mark taken before it started; the pages are kept for reuse. */
+typedef struct treeMark
+{
+  NodeId nodeCount;
+  int constantCount;
+  int dclCount;
+} TreeMark;
+
+SyntaxTree *newTree(void);                          // empty tree with its ROOT node
+TreeNode *treeRoot(SyntaxTree *tree);
+SyntaxTree *treeOf(const TreeNode *node);           // the tree a node belongs to
+void freeTree(SyntaxTree *tree);
+TreeNode *newNode(SyntaxTree *tree, NodeKind nodeKind); // 节点从树的页中分配，不单独释放
+TreeNode *nodeAt(SyntaxTree *tree, NodeId id);      // NULL for NO_NODE
+TreeMark treeMark(SyntaxTree *tree);
+void treeRollback(SyntaxTree *tree, TreeMark mark);
+NodeId appendTree(SyntaxTree *tree, SyntaxTree *from); // 把 from 的节点（ROOT 除外）复制到 tree 的末尾，返回 id 的增量
+void shiftLines(SyntaxTree *tree, NodeId end, int line, int delta); // id < end 且行号大于 line 的节点，行号加 delta
+void printTreeStats(const TreeNode *root);          // 统计模式：节点数、每个节点的字节数、遍历时间
+
+// 遍历：沿着 NodeId 找到相邻的节点，NULL 表示没有
+TreeNode *nodeChild(const TreeNode *node, int i);
+TreeNode *nodeSibling(const TreeNode *node);        // rSibling
+TreeNode *nodePrevSibling(const TreeNode *node);    // lSibling
+TreeNode *nodeParent(const TreeNode *node);
+void setChild(TreeNode *node, int i, TreeNode *child); // also sets child's parent; child may be NULL
+void setSibling(TreeNode *node, TreeNode *next);       // node->rSibling = next, next->lSibling = node
+
+/* traverseTree()
+   Visits tree, its children and its rSibling chain in the order of the old
+   recursive walks: pre(node) first, then the children 0..MAX_CHILDREN-1
+   with their siblings, then post(node), then the next sibling. pre()
+   returns the context for the children of node (siblings keep node's
+   context); NULL pre or post is skipped. data is passed to every call.
+   The stack is on the heap and grows with nesting depth only, so a block
+   of a million statements takes no more native stack than one. */
+typedef void *(*TreeVisitFn)(TreeNode *node, void *context, void *data);
+typedef void (*TreeLeaveFn)(TreeNode *node, void *context, void *data);
+void traverseTree(TreeNode *tree, void *context, TreeVisitFn pre, TreeLeaveFn post, void *data);
+
+// 边表中的字段
+Rational nodeConstant(const TreeNode *node);        // number CONST_EXPR; 0 / 1 otherwise
+void setConstant(TreeNode *node, Rational value);
+int nodeArraySize(const TreeNode *node);            // ARRAY_DCL; 0 otherwise
+void setArraySize(TreeNode *node, int size);
+Bool nodeLazyBody(const TreeNode *node, int *start, int *end); // FUN_DCL 的函数体还没有解析时为 TRUE，*start/*end 为它的 token 范围
+void setLazyBody(TreeNode *node, int start, int end);          // end 为 0 表示没有待解析的函数体
+SymbolTable *nodeScope(const TreeNode *node);       // FUN_DCL; NULL otherwise
+void setNodeScope(TreeNode *node, SymbolTable *scope);
+void *nodeSomething(const TreeNode *node);          // symbol table record of a declaration or reference
+void setNodeSomething(TreeNode *node, void *something);
+
 /*  Not the best design
 typedef struct {
   TreeNode * top; // top of a tree.
@@ -161,7 +227,8 @@ struct Parser;
 typedef struct Parser
 {
   TreeNode *(*parse)(struct Parser *p);
-  void (*set_token_list)(struct Parser *p, List tokenList);
+  void (*set_token_list)(struct Parser *p, List *tokenList);
+  void (*set_token_source)(struct Parser *p, ScanEnv *source);
   void (*print_tree)(struct Parser *p, TreeNode *tree);
   void (*free_tree)(struct Parser *p, TreeNode *tree);
   void *info;
@@ -174,11 +241,35 @@ typedef struct Parser
 // void * info; /* Some data belonging to this parser object. It can contain the tokenList that the parser knows. */
 //} Parser;
 
+/* When the parser pulls tokens from a ScanEnv it keeps only the last
+   PARSE_WINDOW of them: the current token, the two tokens of lookahead and
+   a few behind it for error messages. */
+#define PARSE_WINDOW 8
+
+typedef struct windowToken
+{
+  TokenType type;
+  int lineNum;
+  Symbol sym;
+  Rational value; // INTL, FRACL
+  int lineIndent; // indentation of its line if it is the first token there, -1 otherwise
+  char *text; // owned copy of the token's info; NULL or "" if it has none
+  size_t textCap;
+} WindowToken;
+
 typedef struct ParserInfo
 {
-  Node *currentTokenNode;
-  List tokenList;
-  int errorCount;
+  int current;       // index of the current token in tokenList
+  List *tokenList;   // not owned; the caller frees it after parsing, or after the tree with lazy bodies
+  int eof;           // token list: the index read as END_OF_FILE; a share or a reparse ends there
+  Bool quiet;        // errors are only counted and strings interned later: see parse_program_parallel()
+  ScanEnv *source;   // not owned; when set, tokens are pulled from it instead of tokenList
+  WindowToken window[PARSE_WINDOW]; // token i is window[i % PARSE_WINDOW] while i >= pulled - PARSE_WINDOW
+  int pulled;        // number of tokens pulled from source so far
+  Bool newLine;      // a line end was pulled after the last token
+  int errorCount;    // syntax errors reported by syntaxError()
+  Bool panic;        // an error was reported and the parser has not synchronised since
+  SyntaxTree *tree;  // the tree being built
 } ParserInfo;
 
 // 基本解析器操作
@@ -188,19 +279,36 @@ void destroyParser(Parser *p);
 // 语法分析相关
 TreeNode *parse_program(Parser *p);
 TreeNode *parse(Parser *p);
-void set_token_list(Parser *p, List tokenList);
-void free_tree(Parser *p, TreeNode *tree);
+void set_token_list(Parser *p, List *tokenList);
+void set_token_source(Parser *p, ScanEnv *source);
+void free_tree(Parser *p, TreeNode *tree); // tree 必须是 parse() 返回的 ROOT：一次释放整棵树
+int syntaxErrorCount(Parser *p);          // parse() 之后的语法错误个数；不为 0 时返回的树只含解析成功的部分
+void printParseStats(Parser *p);           // 统计模式：读过的 token 数和回退丢掉的节点数
+void setParseThreads(int threads);         // parse() 解析 token 表使用的线程数，默认 1；0 表示每个 CPU 一个
+int parseThreads(void);
+TreeNode *parse_program_parallel(Parser *p, int threads); // 顶层声明分给多个线程解析，树与 parse_program() 相同
+void setLazyBodies(Bool lazy);             // parse() 只略读函数体，第一次用到时才解析；默认 FALSE
+Bool lazyBodies(void);
+void parseLazyBody(TreeNode *fun);         // 解析 fun 略读过的函数体，挂到 child[1]；nodeChild() 和 traverseTree() 会自动调用
+TreeNode *reparseEdit(Parser *p, TreeNode *tree, size_t start, size_t end, const char *text, size_t len); // 源文件的 [start, end) 换成 text，只重新解析受影响的顶层声明
 
 // 辅助函数
-Token *currentToken(ParserInfo *info);
-Bool checkType(Token *token, TokenType type);
+int currentToken(ParserInfo *info);
+TokenType tokenType(ParserInfo *info, int index);
+const char *tokenText(ParserInfo *info, int index);
+Symbol tokenName(ParserInfo *info, int index);
+Rational tokenNumber(ParserInfo *info, int index); // INTL/FRACL 的值，扫描器已算好
+int tokenLine(ParserInfo *info, int index);
+Bool checkType(ParserInfo *info, int index, TokenType type);
 Bool moveTokenNext(ParserInfo *info);
 Bool checkMove(ParserInfo *info, TokenType type);
-TreeNode *newNode(NodeKind nodeKind);
-void removeNode(TreeNode *node);
+Bool isTypeSpecifier(TokenType t);       // int frac void str
 Bool canStartDeclaration(TokenType t);
 Bool looksLikeFunDeclaration(ParserInfo *f);
-void skipNewlines(ParserInfo *info);
+Bool startsTopLevelLine(ParserInfo *f, int index); // 第一个 token，且该行没有缩进
+void syntaxError(ParserInfo *f, int index, const char *format, ...);
+void synchronizeStatement(ParserInfo *f, int start);
+void synchronizeDeclaration(ParserInfo *f, int start);
 
 // 语法规则解析函数
 TreeNode *declaration_list(ParserInfo *f, Bool *status);
@@ -209,6 +317,7 @@ TreeNode *var_declaration(ParserInfo *f, Bool *status);
 TreeNode *fun_declaration(ParserInfo *f, Bool *status);
 TreeNode *param_list(ParserInfo *f, Bool *status);
 TreeNode *param(ParserInfo *f, Bool *status);
+TreeNode *function_body(ParserInfo *f, TreeNode *fun, Bool *status);
 TreeNode *compound_stmt(ParserInfo *f, Bool *status);
 TreeNode *local_declarations(ParserInfo *f, Bool *status);
 TreeNode *statement_list(ParserInfo *f, Bool *status);
@@ -218,13 +327,8 @@ TreeNode *selection_stmt(ParserInfo *f, Bool *status);
 TreeNode *iteration_stmt(ParserInfo *f, Bool *status);
 TreeNode *return_stmt(ParserInfo *f, Bool *status);
 TreeNode *expression(ParserInfo *f, Bool *status);
+TreeNode *binary_expression(ParserInfo *f, int minPrecedence, Bool *status);
 TreeNode *var(ParserInfo *f, Bool *status);
-TreeNode *simple_expression(ParserInfo *f, Bool *status);
-TreeNode *relop(ParserInfo *f, Bool *status);
-TreeNode *additive_expression(ParserInfo *f, Bool *status);
-TreeNode *addop(ParserInfo *f, Bool *status);
-TreeNode *term(ParserInfo *f, Bool *status);
-TreeNode *mulop(ParserInfo *f, Bool *status);
 TreeNode *factor(ParserInfo *f, Bool *status);
 TreeNode *num(ParserInfo *f, Bool *status);
 TreeNode *Str(ParserInfo *f, Bool *status);
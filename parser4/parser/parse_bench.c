@@ -0,0 +1,224 @@
+/****************************************************
+ File: parse_bench.c
+
+ Microbenchmark of the parser.
+ Usage: parse_bench [-t threads] [file ...]
+
+ Scans each input once, then parses the token list BENCH_ROUNDS times and
+ prints the best time as MB/s and ns per token, with the number of tree
+ nodes made per token; then parses it with lazy function bodies, and with
+ parse_program_parallel() on 1 to threads threads (default: one per
+ online CPU), and times reparseEdit() for edits in a function in the
+ middle of the input. Without files it parses a generated input of
+ functions whose bodies are all expressions, and one of BENCH_FUNCTIONS
+ small functions.
+ ****************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parse.h"
+
+#define BENCH_BYTES (4 * 1024 * 1024)
+#define BENCH_ROUNDS 5
+#define BENCH_FUNCTIONS 50000
+#define BENCH_EDITS 1000
+
+static double now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Repeat unit until the buffer holds about BENCH_BYTES. */
+static char *generate(const char *unit, size_t *len)
+{
+    size_t n = strlen(unit);
+    size_t count = BENCH_BYTES / n;
+    char *text = (char *)malloc(count * n);
+    if (text == NULL)
+    {
+        fprintf(stderr, "parse_bench: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++)
+        memcpy(text + i * n, unit, n);
+    *len = count * n;
+    return text;
+}
+
+static char *readAll(const char *filename, size_t *len)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        perror(filename);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = (char *)malloc(size > 0 ? size : 1);
+    *len = fread(text, 1, size, file);
+    fclose(file);
+    return text;
+}
+
+/* The best of BENCH_ROUNDS parses of list on threads threads; 0 if it
+   does not parse. *nodes is the size of the tree. */
+static double timeParse(List *list, int threads, NodeId *nodes)
+{
+    double fastest = 1e30;
+    setParseThreads(threads);
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        Parser *parser = createParser();
+        parser->set_token_list(parser, list);
+        double t0 = now();
+        TreeNode *tree = parser->parse(parser);
+        double t = now() - t0;
+        if (tree == NULL || syntaxErrorCount(parser) > 0)
+        {
+            parser->free_tree(parser, tree);
+            destroyParser(parser);
+            return 0;
+        }
+        if (t < fastest)
+            fastest = t;
+        *nodes = treeOf(tree)->nodeCount;
+        parser->free_tree(parser, tree);
+        destroyParser(parser);
+    }
+    return fastest;
+}
+
+/* Time reparseEdit() on tree, typing text in at offset and taking it out
+   again, BENCH_EDITS times: the time per edit, 0 if it did not parse. */
+static double timeEdits(Parser *parser, TreeNode **tree, size_t offset, const char *text)
+{
+    size_t n = strlen(text);
+    double t0 = now();
+    for (int i = 0; i < BENCH_EDITS && syntaxErrorCount(parser) == 0; i++)
+    {
+        *tree = reparseEdit(parser, *tree, offset, offset, text, n);
+        *tree = reparseEdit(parser, *tree, offset, offset + n, "", 0);
+    }
+    return syntaxErrorCount(parser) == 0 ? (now() - t0) / (2 * BENCH_EDITS) : 0;
+}
+
+/* Edit list, which is changed, in the first function with a return in
+   the second half of the text: a term typed into the return, which keeps
+   the lines where they are, and a statement typed in before it, which
+   moves the lines behind it. full is the time of a whole parse. */
+static void benchEdits(const char *name, List *list, double full)
+{
+    const char *at = strstr(list->text + list->textLen / 2, "    return");
+    const char *semi = at != NULL ? strchr(at, ';') : NULL;
+    if (semi == NULL)
+        return;
+    size_t line = at - list->text;
+    size_t term = semi - list->text;
+    setParseThreads(1);
+    Parser *parser = createParser();
+    parser->set_token_list(parser, list);
+    TreeNode *tree = parser->parse(parser);
+    double inLine = timeEdits(parser, &tree, term, " + 1");
+    double newLine = timeEdits(parser, &tree, line, "    x = x + 1;\n");
+    if (inLine > 0 && newLine > 0)
+        printf("%-12s %8.1f us per edit in a line, %8.1f us adding a line  (a parse takes %.1f us)\n",
+               name, inLine * 1e6, newLine * 1e6, full * 1e6);
+    parser->free_tree(parser, tree);
+    destroyParser(parser);
+}
+
+static void bench(const char *name, const char *text, size_t len, int maxThreads)
+{
+    List *list = scanBuffer(text, len);
+    if (list == NULL)
+    {
+        fprintf(stderr, "parse_bench: %s could not be scanned\n", name);
+        return;
+    }
+    NodeId nodes = 0;
+    double fastest = timeParse(list, 1, &nodes);
+    if (fastest == 0)
+    {
+        fprintf(stderr, "parse_bench: %s does not parse\n", name);
+        deleteList(list);
+        return;
+    }
+    printf("%-12s %8.1f MB/s %8.1f ns per token  (%d tokens, %.2f nodes per token)\n",
+           name, len / fastest / 1e6, fastest * 1e9 / list->size, list->size, (double)nodes / list->size);
+
+    /* declarations only: the function bodies are skimmed, see setLazyBodies() */
+    double single = fastest;
+    setLazyBodies(TRUE);
+    fastest = timeParse(list, 1, &nodes);
+    setLazyBodies(FALSE);
+    if (fastest > 0)
+        printf("%-12s lazy bodies %7.1f MB/s  (x%.2f, %u nodes)\n", name, len / fastest / 1e6, single / fastest, nodes);
+
+    /* scaling of the parallel parser */
+    for (int threads = 2; threads <= maxThreads; threads++)
+    {
+        fastest = timeParse(list, threads, &nodes);
+        if (fastest > 0)
+            printf("%-12s %2d threads %8.1f MB/s  (x%.2f)\n", name, threads, len / fastest / 1e6, single / fastest);
+    }
+    benchEdits(name, list, single);
+    deleteList(list);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t len;
+    char *text;
+    int maxThreads = scanThreads();
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-t") == 0)
+    {
+        maxThreads = atoi(argv[2]);
+        first = 3;
+    }
+    if (argc > first)
+    {
+        for (int i = first; i < argc; i++)
+        {
+            text = readAll(argv[i], &len);
+            bench(argv[i], text, len, maxThreads);
+            free(text);
+        }
+        internFree();
+        return 0;
+    }
+
+    text = generate("int f(int a) {\n"
+                    "    a = b * c + d / e - g % h;\n"
+                    "    x[i + 1] = y * 2 - (a + 3) / b;\n"
+                    "    r = a < b + c * d;\n"
+                    "    return (a + b) * (c - d) / 2:3;\n"
+                    "}\n",
+                    &len);
+    bench("expressions", text, len, maxThreads);
+    free(text);
+
+    /* BENCH_FUNCTIONS functions, each with its own name */
+    size_t cap = (size_t)BENCH_FUNCTIONS * 160;
+    text = (char *)malloc(cap);
+    len = 0;
+    for (int i = 0; text != NULL && i < BENCH_FUNCTIONS; i++)
+        len += snprintf(text + len, cap - len,
+                        "int f%d(int a, int b[]) {\n"
+                        "    int x;\n"
+                        "    x = a * %d + b[a - 1];\n"
+                        "    while (x > 0) x = x - f%d(x, b);\n"
+                        "    return x;\n"
+                        "}\n",
+                        i, i, i);
+    if (text != NULL)
+        bench("functions", text, len, maxThreads);
+    free(text);
+    internFree();
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include "parse.h"
 #include "parse_print.h"
 #include <stdio.h>
+#include <stdint.h>
 #include "scanner.h"
 #include "libs.h"
 
@@ -44,143 +45,152 @@ void print_spaces(int indentNum)
 		printf(" ");
 }
 
-/* procedure print_tree prints a syntax tree to the
-   listing file using indentation to indicate subtrees
-   handle FOR_STMT  13/nov/2014
+/* print_line()
+   The line of one node, for traverseTree(): context is the depth of the
+   node, and its children are one deeper.
  */
-void print_tree(Parser *p, TreeNode *tree)
+static void *print_line(TreeNode *tree, void *context, void *data)
 {
-	int i;
-
-	/* Variable indentNum is used by printTree to
-	 * store current number of spaces to indent
-	 */
-	static int indentNum = 0;
-
-	indentNum += INDENT_GAP;
-	while (tree != NULL)
+	intptr_t depth = (intptr_t)context;
+	(void)data;
+	print_spaces((int)depth * INDENT_GAP); /* Each case only prints one line, If print more than one line, need use printSpaces() first.*/
+	// printf("%d ",  tree->lineNum);
+	if (tree->nodeKind == DCL_ND)
 	{
-		print_spaces(indentNum); /* Each case only prints one line, If print more than one line, need use printSpaces() first.*/
-		// printf("%d ",  tree->lineNum);
-		if (tree->nodeKind == DCL_ND)
+		printf("Declare:  ");
+		print_expr_type(tree->type);
+		printf(" %s ", symbolName(tree->name));
+		// print the [size] only if it is an array.
+		switch (tree->kind)
 		{
-			printf("Declare:  ");
-			print_expr_type(tree->attr.dclAttr.type);
-			printf(" %s ", tree->attr.dclAttr.name);
-			// print the [size] only if it is an array.
-			switch (tree->kind.dcl)
-			{
-			case ARRAY_DCL:
-				printf("[%d]\n", tree->attr.dclAttr.size);
-				break;
-			case FUN_DCL:
-				printf("function with parameters :\n");
-				// Function parameters will be saved as child[0] of the node
-				break;
-			case VAR_DCL:
-				// do nothing
-				printf("\n");
-				break;
-			default:
-				printf("Unknown DclNode kind\n");
-				break;
-			}
+		case ARRAY_DCL:
+			printf("[%d]\n", nodeArraySize(tree));
+			break;
+		case FUN_DCL:
+			printf("function with parameters :\n");
+			// Function parameters will be saved as child[0] of the node
+			break;
+		case VAR_DCL:
+			// do nothing
+			printf("\n");
+			break;
+		default:
+			printf("Unknown DclNode kind\n");
+			break;
 		}
-		else if (tree->nodeKind == PARAM_ND)
+	}
+	else if (tree->nodeKind == PARAM_ND)
+	{
+		printf("Parameter: ");
+		print_expr_type(tree->type);
+		if (tree->type != VOID_TYPE)
 		{
-			printf("Parameter: ");
-			print_expr_type(tree->attr.dclAttr.type);
-			if (tree->attr.dclAttr.type != VOID_TYPE)
-			{
-				printf(" %s", tree->attr.dclAttr.name);
-				if (tree->kind.param == ARRAY_PARAM)
-					printf("[ ]");
-			}
-			printf("\n");
+			printf(" %s", symbolName(tree->name));
+			if (tree->kind == ARRAY_PARAM)
+				printf("[ ]");
 		}
-		else if (tree->nodeKind == STMT_ND)
+		printf("\n");
+	}
+	else if (tree->nodeKind == STMT_ND)
+	{
+		switch (tree->kind)
 		{
-			switch (tree->kind.stmt)
-			{
-			case SLCT_STMT:
-				printf("If ");
-				if (tree->child[2] != NULL) // has else part
-					printf(" with ELSE \n");
-				else
-					printf(" without ELSE \n");
-				break;
-				//  case ITER_STMTMT:
-			case WHILE_STMT:
-				printf("while stmt: \n");
-				break;
-			case FOR_STMT:
-				printf("for stmt: \n");
-				break;
-			case DO_WHILE_STMT:
-				printf("do while stmt: \n");
-				break;
-			case EXPR_STMT:
-				printf("Expression stmt: \n");
-				break;
-			case CMPD_STMT:
-				printf("Compound Stmt:\n");
-				break;
-			case RTN_STMT:
-				printf("Return \n");
-				// if there is a return value, it is  child[0].
-				break;
-			case NULL_STMT:
-				printf("Null statement:  ;\n");
-				break;
-			default:
-				printf("Unknown StmtNode kind\n");
-				break;
-			}
+		case SLCT_STMT:
+			printf("If ");
+			if (tree->child[2] != NO_NODE) // has else part
+				printf(" with ELSE \n");
+			else
+				printf(" without ELSE \n");
+			break;
+			//  case ITER_STMTMT:
+		case WHILE_STMT:
+			printf("while stmt: \n");
+			break;
+		case FOR_STMT:
+			printf("for stmt: \n");
+			break;
+		case DO_WHILE_STMT:
+			printf("do while stmt: \n");
+			break;
+		case EXPR_STMT:
+			printf("Expression stmt: \n");
+			break;
+		case CMPD_STMT:
+			printf("Compound Stmt:\n");
+			break;
+		case RTN_STMT:
+			printf("Return \n");
+			// if there is a return value, it is  child[0].
+			break;
+		case NULL_STMT:
+			printf("Null statement:  ;\n");
+			break;
+		default:
+			printf("Unknown StmtNode kind\n");
+			break;
 		}
-		else if (tree->nodeKind == EXPR_ND)
+	}
+	else if (tree->nodeKind == EXPR_ND)
+	{
+		switch (tree->kind)
 		{
-			switch (tree->kind.expr)
-			{
-			case OP_EXPR:
-				printf("Operator: ");
-				if (tree->attr.exprAttr.op == LBRA)
-					printf("[] index operator");
-				else
-					printf("%s", token_type_to_string(tree->attr.exprAttr.op));
-				printf("\n");
-				break;
-			case CONST_EXPR:
-				printf("Const: %d\n", tree->attr.exprAttr.val);
-				break;
-			case ID_EXPR:
-				printf("ID: %s\n", tree->attr.exprAttr.name);
-				break;
+		case OP_EXPR:
+			printf("Operator: ");
+			if (tree->op == LBRA)
+				printf("[] index operator");
+			else
+				printf("%s", token_type_to_string(tree->op));
+			if ((tree->op == PPLUS || tree->op == MMINUS) && tree->extra)
+				printf(" (postfix)");
+			printf("\n");
+			break;
+		case CONST_EXPR:
+			if (tree->type == STR_TYPE)
+				printf("Const: %s\n", symbolName(tree->name)); // 字符串常量的文本带着引号
+			else if (nodeConstant(tree).den == 1)
+				printf("Const: %lld\n", (long long)nodeConstant(tree).num);
+			else // 分数按源程序的写法 a:b 打印（已约分）
+				printf("Const: %lld:%lld\n", (long long)nodeConstant(tree).num, (long long)nodeConstant(tree).den);
+			break;
+		case ID_EXPR:
+			printf("ID: %s\n", symbolName(tree->name));
+			break;
 
-			case ARRAY_EXPR:
-				printf("Array: %s, with member index:\n", tree->attr.exprAttr.name);
-				break;
+		case ARRAY_EXPR:
+			printf("Array: %s, with member index:\n", symbolName(tree->name));
+			break;
 
-			case CALL_EXPR:
-				printf("Call function: %s, with arguments:\n", tree->attr.exprAttr.name);
-				break;
-				/* arguments are listed as  child[0]
-				  remove ASN_EXP, since it is just an operator expression 13/NOV/2014
-			case ASN_EXP:
-			printf("Assignment, with LHS and RHS:\n");
+		case CALL_EXPR:
+			printf("Call function: %s, with arguments:\n", symbolName(tree->name));
+			break;
+		case ASN_EXPR:
+			printf("Assignment: %s, with LHS and RHS:\n", token_type_to_string(tree->op));
+			break;
+			/* arguments are listed as  child[0]
+			  remove ASN_EXP, since it is just an operator expression 13/NOV/2014
+		case ASN_EXP:
+		printf("Assignment, with LHS and RHS:\n");
+		break;
+			 */
+		default:
+			printf("Unknown ExpNode kind\n");
 			break;
-				 */
-			default:
-				printf("Unknown ExpNode kind\n");
-				break;
-			}
 		}
-		else
-			printf("Unknown node kind\n");
-		for (i = 0; i < MAX_CHILDREN; i++)
-			print_tree(p, tree->child[i]);
-		tree = tree->rSibling;
-	} // end of while loop.
-	indentNum -= INDENT_GAP;
+	}
+	else
+		printf("Unknown node kind\n");
+	return (void *)(depth + 1);
+}
+
+/* procedure print_tree prints a syntax tree to the
+   listing file using indentation to indicate subtrees
+   handle FOR_STMT  13/nov/2014
+   The walk is traverseTree(), so a long block does not deepen the C stack.
+ */
+void print_tree(Parser *p, TreeNode *tree)
+{
+	(void)p;
+	traverseTree(tree, (void *)(intptr_t)1, print_line, NULL, NULL);
 }
 
 void print_stmt_type(StmtKind t)
@@ -515,6 +525,8 @@ const char *token_type_to_string(TokenType token)
 		return ",";
 	case INDENT:
 		return "INDENT";
+	case DEDENT:
+		return "DEDENT";
 	case COMMENT:
 		return "COMMENT";
 	case DO:
@@ -572,14 +584,41 @@ char *read_file(const char *filename)
 	return content;
 }
 // 生成解析树
-TreeNode *generate_parse_tree(const char *filename)
+/* parse_token_list()
+   Parse a list made by scanFile() or scanBuffer(), then delete it. The
+   list is gone when the tree is used, so the function bodies are parsed
+   right away even in lazy mode (see setLazyBodies()). */
+static TreeNode *parse_token_list(List *tokenList)
 {
+	if (tokenList->diagCount > 0) // 词法错误：报告后放弃，不退出程序
+	{
+		printDiagnostics(tokenList, stderr);
+		deleteList(tokenList);
+		return NULL;
+	}
 	Parser *parser = createParser();
-	List *tokenList = scanFile(filename); // 使用 scanFile 函数
-	parser->set_token_list(parser, *tokenList);
+	parser->set_token_list(parser, tokenList);
+	Bool lazy = lazyBodies();
+	setLazyBodies(FALSE);
 	TreeNode *tree = parser->parse(parser);
-	freeList(tokenList); // 释放 tokenList
-	free(tokenList);	 // 释放 tokenList 指针
+	setLazyBodies(lazy);
+	deleteList(tokenList); // 释放 tokenList；树中的名字在标识符池里，不受影响
 	destroyParser(parser);
 	return tree;
+}
+
+TreeNode *generate_parse_tree(const char *filename)
+{
+	List *tokenList = scanFile(filename); // 使用 scanFile 函数
+	if (tokenList == NULL)
+		return NULL;
+	return parse_token_list(tokenList);
+}
+
+/* generate_parse_tree_from_buffer()
+   generate_parse_tree() for source text in memory; the file system is not
+   used. data is only needed until this returns. */
+TreeNode *generate_parse_tree_from_buffer(const char *data, size_t len)
+{
+	return parse_token_list(scanBuffer(data, len));
 }
\ No newline at end of file
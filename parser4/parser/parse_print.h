@@ -24,5 +24,7 @@ void print_indent(int);
 void print_token_type(TokenType);
 void print_node(TreeNode *);
 const char *token_type_to_string(TokenType token); // 添加函数原型声明
+TreeNode *generate_parse_tree(const char *filename);                  // 扫描并解析一个源文件
+TreeNode *generate_parse_tree_from_buffer(const char *data, size_t len); // 同上，源文件已在内存中，不读文件
 
 #endif
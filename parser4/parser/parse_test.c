@@ -0,0 +1,341 @@
+/****************************************************
+ File: parse_test.c
+
+ Regression test of the parser.
+ Usage: parse_test [deep]
+
+ Parses each program of a fixed corpus from a token list, from a token
+ list with lazy function bodies, and pulled from a token stream. The
+ corpus repeated to THREADS_TOKENS tokens is parsed on 1 to TEST_THREADS
+ threads, well above the size parse() starts to split at: every tree
+ must print the same and have as many nodes as the serial one. Every parse must report no syntax error, consume every
+ token but END_OF_FILE, and give no node back to treeRollback(): a
+ rollback on a valid program is parse work the grammar could have
+ avoided. With deep, parses instead one function of DEEP_STATEMENTS
+ statements and walks it with traverseTree() and print_tree() on a
+ thread with a DEEP_STACK byte stack, where a walk that recursed along
+ the statements would overflow. Exits with 1 if any check fails.
+ ****************************************************/
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "parse.h"
+#include "parse_print.h"
+
+#define TEST_THREADS 7
+#define THREADS_TOKENS 300000
+#define DEEP_STATEMENTS 1000000
+#define DEEP_STACK (64 * 1024)
+
+static const char *corpus[] = {
+    /* declarations, parameters and return */
+    "int n;\n"
+    "int a[10];\n"
+    "frac q;\n"
+    "str s;\n"
+    "int main(int a, int b[]) {\n"
+    "    int i;\n"
+    "    frac f[3];\n"
+    "    i = a + b[0];\n"
+    "    return i;\n"
+    "}\n"
+    "void v(void) { s = \"x\"; }\n"
+    "int g() { return 1; }\n",
+
+    /* expressions */
+    "int main(int a) {\n"
+    "    a = b + c * d - e / f % g;\n"
+    "    x[i + 1] += y ** -z ** 2;\n"
+    "    r = a << 2 >> b || c && d | e & f == g < h;\n"
+    "    k = !p + -q * f(1, 2:3, \"s\") + g();\n"
+    "    i = g() + h(a[i], f(1, k(2)));\n"
+    "    a++;\n"
+    "    --x[i];\n"
+    "    i = ++a + a-- * 2;\n"
+    "    return (a + b) * c;\n"
+    "}\n",
+
+    /* statements with braces */
+    "int h(int a) {\n"
+    "    while (a > 0)\n"
+    "        a = a - 1;\n"
+    "    if (a == 0) { a = h(a); } else a = 1;\n"
+    "    while (a < 10) { a = a + 1; }\n"
+    "    ;\n"
+    "    { ; }\n"
+    "    print(\"done\");\n"
+    "    return a;\n"
+    "}\n",
+
+    /* statements with the off-side rule, comments */
+    "int main(int a, int b) {\n"
+    "    # comment here\n"
+    "    x = a + 1;\n"
+    "    // line comment\n"
+    "    /* block\n"
+    "       comment */\n"
+    "    y = 3:4;\n"
+    "    while x > y :\n"
+    "        x += 1;\n"
+    "        y = y - 1;\n"
+    "    if x == y :\n"
+    "        x = 0;\n"
+    "    return x;\n"
+    "}\n",
+};
+
+static int failures = 0;
+
+static void check(const char *what, int index, Parser *parser, int total)
+{
+    ParserInfo *info = (ParserInfo *)parser->info;
+    int errors = syntaxErrorCount(parser);
+    NodeId rolledBack = info->tree ? info->tree->rolledBack : 0;
+    if (errors == 0 && info->current == total - 1 && rolledBack == 0)
+        return;
+    fprintf(stderr, "parse_test: program %d (%s): %d syntax errors, %d of %d tokens consumed, %u nodes rolled back\n",
+            index, what, errors, info->current, total, rolledBack);
+    failures++;
+}
+
+/* Parse list with the given parse settings. Lazy bodies are all parsed
+   before the check, so their rollbacks count too. */
+static void testList(const char *what, int index, List *list, int threads, Bool lazy)
+{
+    setParseThreads(threads);
+    setLazyBodies(lazy);
+    Parser *parser = createParser();
+    parser->set_token_list(parser, list);
+    TreeNode *tree = parser->parse(parser);
+    for (TreeNode *dcl = nodeChild(tree, 0); dcl != NULL; dcl = nodeSibling(dcl))
+    {
+        if (dcl->kind == FUN_DCL && nodeChild(dcl, 1) == NULL)
+        {
+            fprintf(stderr, "parse_test: program %d (%s): a function body does not parse\n", index, what);
+            failures++;
+        }
+    }
+    check(what, index, parser, list->size);
+    parser->free_tree(parser, tree);
+    destroyParser(parser);
+    setParseThreads(1);
+    setLazyBodies(FALSE);
+}
+
+/* What print_tree() writes for tree, in a malloc'd buffer of *len bytes. */
+static char *printed(Parser *parser, TreeNode *tree, long *len)
+{
+    FILE *capture = tmpfile();
+    if (capture == NULL)
+    {
+        *len = 0;
+        return NULL;
+    }
+    fflush(stdout);
+    int out = dup(STDOUT_FILENO);
+    dup2(fileno(capture), STDOUT_FILENO);
+    print_tree(parser, tree);
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    *len = ftell(capture);
+    char *text = (char *)malloc(*len > 0 ? *len : 1);
+    rewind(capture);
+    if (text != NULL && fread(text, 1, *len, capture) != (size_t)*len)
+        *len = 0;
+    fclose(capture);
+    return text;
+}
+
+/* The corpus repeated to THREADS_TOKENS tokens, parsed on 1 thread and
+   then on more. */
+static void testThreads(void)
+{
+    int programs = (int)(sizeof(corpus) / sizeof(corpus[0]));
+    size_t unit = 0;
+    for (int i = 0; i < programs; i++)
+        unit += strlen(corpus[i]);
+    List *one = scanBuffer(corpus[0], strlen(corpus[0]));
+    size_t copies = (size_t)THREADS_TOKENS / one->size + 1; // the first program has the fewest tokens per byte
+    deleteList(one);
+    char *text = (char *)malloc(copies * unit + 1);
+    if (text == NULL)
+    {
+        fprintf(stderr, "parse_test: out of memory\n");
+        failures++;
+        return;
+    }
+    size_t len = 0;
+    for (size_t c = 0; c < copies; c++)
+    {
+        for (int i = 0; i < programs; i++)
+        {
+            memcpy(text + len, corpus[i], strlen(corpus[i]));
+            len += strlen(corpus[i]);
+        }
+    }
+    List *list = scanBuffer(text, len);
+
+    char *serial = NULL;
+    long serialLen = 0;
+    NodeId serialNodes = 0;
+    for (int threads = 1; threads <= TEST_THREADS; threads++)
+    {
+        setParseThreads(threads);
+        Parser *parser = createParser();
+        parser->set_token_list(parser, list);
+        TreeNode *tree = parser->parse(parser);
+        char what[32];
+        snprintf(what, sizeof(what), "%d threads", threads);
+        check(what, programs, parser, list->size);
+        long printedLen;
+        char *out = printed(parser, tree, &printedLen);
+        NodeId nodes = treeOf(tree)->nodeCount;
+        if (threads == 1)
+        {
+            serial = out;
+            serialLen = printedLen;
+            serialNodes = nodes;
+        }
+        else
+        {
+            if (out == NULL || printedLen != serialLen || memcmp(out, serial, serialLen) != 0 || nodes != serialNodes)
+            {
+                fprintf(stderr, "parse_test: %s: the tree (%u nodes) differs from the serial one (%u nodes)\n",
+                        what, nodes, serialNodes);
+                failures++;
+            }
+            free(out);
+        }
+        parser->free_tree(parser, tree);
+        destroyParser(parser);
+    }
+    setParseThreads(1);
+    if (serial == NULL || serialLen == 0)
+    {
+        fprintf(stderr, "parse_test: the tree could not be printed\n");
+        failures++;
+    }
+    free(serial);
+    deleteList(list);
+    free(text);
+}
+
+static void testStream(int index, const char *text)
+{
+    ScanEnv *source = scanOpenBuffer(text, strlen(text));
+    Parser *parser = createParser();
+    parser->set_token_source(parser, source);
+    TreeNode *tree = parser->parse(parser);
+    check("stream", index, parser, ((ParserInfo *)parser->info)->pulled);
+    parser->free_tree(parser, tree);
+    destroyParser(parser);
+    scanClose(source);
+}
+
+static void *countNode(TreeNode *node, void *context, void *data)
+{
+    (void)node;
+    (*(NodeId *)data)++;
+    return context;
+}
+
+typedef struct
+{
+    Parser *parser;
+    TreeNode *tree;
+    NodeId visited;
+} DeepWalk;
+
+/* The walks of testDeep(), on the small stack. print_tree() writes to
+   /dev/null. */
+static void *deepWalk(void *arg)
+{
+    DeepWalk *walk = (DeepWalk *)arg;
+    traverseTree(walk->tree, NULL, countNode, NULL, &walk->visited);
+    fflush(stdout);
+    int out = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    print_tree(walk->parser, walk->tree);
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(null);
+    close(out);
+    return NULL;
+}
+
+static int testDeep(void)
+{
+    static const char statement[] = "    x = x + 1;\n";
+    size_t n = sizeof(statement) - 1;
+    size_t len = strlen("int main(int x) {\n") + DEEP_STATEMENTS * n + strlen("    return x;\n}\n");
+    char *text = (char *)malloc(len + 1);
+    if (text == NULL)
+    {
+        fprintf(stderr, "parse_test: out of memory\n");
+        return 1;
+    }
+    char *p = text + sprintf(text, "int main(int x) {\n");
+    for (int i = 0; i < DEEP_STATEMENTS; i++, p += n)
+        memcpy(p, statement, n);
+    strcpy(p, "    return x;\n}\n");
+
+    List *list = scanBuffer(text, len);
+    Parser *parser = createParser();
+    parser->set_token_list(parser, list);
+    DeepWalk walk = {parser, parser->parse(parser), 0};
+    check("deep", 0, parser, list->size);
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, DEEP_STACK < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : DEEP_STACK);
+    if (pthread_create(&thread, &attr, deepWalk, &walk) != 0)
+    {
+        fprintf(stderr, "parse_test: cannot start the walk thread\n");
+        failures++;
+    }
+    else
+        pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    NodeId nodes = treeOf(walk.tree)->nodeCount - 1; // id 0 is NO_NODE
+    if (walk.visited != nodes)
+    {
+        fprintf(stderr, "parse_test: deep: %u of %u nodes visited\n", walk.visited, nodes);
+        failures++;
+    }
+    printf("parse_test: %d statements, %u nodes visited\n", DEEP_STATEMENTS, walk.visited);
+
+    parser->free_tree(parser, walk.tree);
+    destroyParser(parser);
+    deleteList(list);
+    free(text);
+    internFree();
+    return failures > 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "deep") == 0)
+        return testDeep();
+    int programs = (int)(sizeof(corpus) / sizeof(corpus[0]));
+    for (int i = 0; i < programs; i++)
+    {
+        List *list = scanBuffer(corpus[i], strlen(corpus[i]));
+        testList("list", i, list, 1, FALSE);
+        testList("lazy bodies", i, list, 1, TRUE);
+        deleteList(list);
+        testStream(i, corpus[i]);
+    }
+    testThreads();
+    internFree();
+    if (failures > 0)
+        return 1;
+    printf("parse_test: %d programs parsed\n", programs);
+    return 0;
+}
@@ -0,0 +1,102 @@
+/****************************************************
+ File: rational.c
+
+ Literal values as exact fractions. Reduction uses the binary GCD
+ (Stein's algorithm): common factors of two are taken out with one
+ count-trailing-zeros, and the odd parts are reduced by subtraction, so
+ there is no division in the loop.
+ ****************************************************/
+#include "rational.h"
+
+static int trailingZeros(uint64_t x) // x != 0
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1))
+    {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+uint64_t binaryGcd(uint64_t a, uint64_t b)
+{
+    if (a == 0)
+        return b;
+    if (b == 0)
+        return a;
+    int shift = trailingZeros(a | b);
+    a >>= trailingZeros(a);
+    do
+    {
+        b >>= trailingZeros(b);
+        if (a > b)
+        {
+            uint64_t t = a;
+            a = b;
+            b = t;
+        }
+        b -= a;
+    } while (b != 0);
+    return a << shift;
+}
+
+/* |x| without overflow for INT64_MIN */
+static uint64_t magnitude(int64_t x)
+{
+    return x < 0 ? 0 - (uint64_t)x : (uint64_t)x;
+}
+
+Rational makeRational(int64_t num, int64_t den)
+{
+    Rational r;
+    uint64_t g = binaryGcd(magnitude(num), magnitude(den));
+    uint64_t n = magnitude(num) / g;
+    uint64_t d = magnitude(den) / g;
+    int negative = (num < 0) != (den < 0) && n != 0;
+    /* results of magnitude 2^63 only fit as -2^63; literals never need them */
+    r.num = negative ? (int64_t)(0 - n) : (int64_t)n;
+    r.den = (int64_t)d;
+    return r;
+}
+
+/* Decimal digits [s, end) into *v; 0 if the value exceeds INT64_MAX. */
+static int parseDigits(const char *s, const char *end, int64_t *v)
+{
+    uint64_t x = 0;
+    for (; s < end; s++)
+    {
+        unsigned d = (unsigned)(*s - '0');
+        if (x > ((uint64_t)INT64_MAX - d) / 10)
+            return 0;
+        x = x * 10 + d;
+    }
+    *v = (int64_t)x;
+    return 1;
+}
+
+const char *parseLiteral(const char *s, size_t n, Rational *value)
+{
+    const char *end = s + n;
+    const char *colon = s;
+    int64_t num, den = 1;
+    while (colon < end && *colon != ':')
+        colon++;
+    value->num = 0;
+    value->den = 1;
+    if (!parseDigits(s, colon, &num))
+        return "Number too large.";
+    if (colon < end)
+    {
+        if (!parseDigits(colon + 1, end, &den))
+            return "Number too large.";
+        if (den == 0)
+            return "Fraction has a zero denominator.";
+    }
+    *value = makeRational(num, den);
+    return NULL;
+}
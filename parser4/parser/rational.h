@@ -0,0 +1,23 @@
+#ifndef RATIONAL_H
+#define RATIONAL_H
+#include <stddef.h>
+#include <stdint.h>
+
+/* The exact value of a number literal, worked out once by the scanner so
+   that later stages never parse the text again. An INTL n is n / 1; a
+   FRACL a:b is a / b. Values are kept in lowest terms with den > 0, so
+   two equal values always have equal fields. */
+typedef struct rational
+{
+    int64_t num;
+    int64_t den;
+} Rational;
+
+uint64_t binaryGcd(uint64_t a, uint64_t b); // gcd(a, 0) == a
+Rational makeRational(int64_t num, int64_t den); // reduced; den must not be 0
+
+/* Value of the INTL or FRACL text [s, s + n). Returns NULL, or a message
+   if the value does not fit (then *value is 0 / 1). */
+const char *parseLiteral(const char *s, size_t n, Rational *value);
+
+#endif
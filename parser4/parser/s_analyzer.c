@@ -13,23 +13,12 @@ typedef struct analyzerInfo
 
 Bool A_debugAnalyzer = FALSE; /* by default as false, do not print debug information of running the analyzer*/
 
-TreeNode *new_param_node(ParamKind kind, int lineno)
+/* The node is added to tree, and goes away with it. */
+TreeNode *new_param_node(SyntaxTree *tree, ParamKind kind, int lineno)
 {
-	TreeNode *node = (TreeNode *)malloc(sizeof(TreeNode));
-	if (node == NULL)
-	{
-		fprintf(stderr, "Out of memory error at line %d\n", lineno);
-		exit(EXIT_FAILURE);
-	}
-	node->nodeKind = PARAM_ND;
+	TreeNode *node = newNode(tree, PARAM_ND);
 	node->lineNum = lineno;
-	node->kind.param = kind;
-	// 初始化其他字段
-	for (int i = 0; i < MAX_CHILDREN; i++)
-		node->child[i] = NULL;
-	node->lSibling = NULL;
-	node->rSibling = NULL;
-	node->attr.dclAttr.name = NULL;
+	node->kind = kind;
 	return node;
 }
 
@@ -48,60 +37,82 @@ TreeNode *new_param_node(ParamKind kind, int lineno)
 static void top_symbtb_initialize(AnalyzerInfo *info)
 {
 	TreeNode *nd = info->parseTree;
-	/* add the read(), write(), and print() functions. Assume they appear at line 0. */
-	TreeNode *readNd = newNode(DCL_ND);
-	TreeNode *writeNd = newNode(DCL_ND);
-	TreeNode *printNd = newNode(DCL_ND);
-	if (readNd == NULL || writeNd == NULL || printNd == NULL)
-	{
-		fprintf(stderr, "Out of memory error\n");
-		exit(EXIT_FAILURE);
-	}
 	if (nd == NULL)
 	{
 		return;
 	}
+	/* add the read(), write(), and print() functions. Assume they appear at line 0.
+	   Their nodes are added to the syntax tree, like every other node. */
+	SyntaxTree *tree = treeOf(nd);
+	TreeNode *readNd = newNode(tree, DCL_ND);
+	TreeNode *writeNd = newNode(tree, DCL_ND);
+	TreeNode *printNd = newNode(tree, DCL_ND);
 	if (A_debugAnalyzer)
 		printf("%20s \n", __FUNCTION__);
 
 	info->symbolTable = st_initialize(TRUE); /* create an empty symbol table with id 0 */
 
-	readNd->attr.dclAttr.type = INT_TYPE;
-	writeNd->attr.dclAttr.type = VOID_TYPE;
-	readNd->attr.dclAttr.name = "read";
-	writeNd->attr.dclAttr.name = "write";
+	readNd->type = INT_TYPE;
+	writeNd->type = VOID_TYPE;
+	readNd->name = internString("read");
+	writeNd->name = internString("write");
+	printNd->type = VOID_TYPE;
+	printNd->name = internString("print");
 
-	TreeNode *p1 = new_param_node(VOID_PARAM, 0);
-	p1->attr.dclAttr.type = VOID_TYPE;
-	p1->attr.dclAttr.name = "void"; /* this is not required */
+	TreeNode *p1 = new_param_node(tree, VOID_PARAM, 0);
+	p1->type = VOID_TYPE;
+	p1->name = internString("void"); /* this is not required */
 
-	TreeNode *p2 = new_param_node(VAR_PARAM, 0);
-	if (nd->child[0]->type != INT_TYPE)
+	TreeNode *p2 = new_param_node(tree, VAR_PARAM, 0);
+	if (nodeChild(nd, 0)->type != INT_TYPE)
 	{
-		p2->attr.dclAttr.type = INT_TYPE;
+		p2->type = INT_TYPE;
 	}
 	else
 	{
-		p2->attr.dclAttr.type = FRAC_TYPE;
+		p2->type = FRAC_TYPE;
 	}
-	p2->attr.dclAttr.name = "x";
+	p2->name = internString("x");
 
-	TreeNode *p3 = new_param_node(VAR_PARAM, 0);
-	p3->attr.dclAttr.type = STR_TYPE;
-	p3->attr.dclAttr.name = "y";
+	TreeNode *p3 = new_param_node(tree, VAR_PARAM, 0);
+	p3->type = STR_TYPE;
+	p3->name = internString("y");
 
-	readNd->child[0] = p1;
-	writeNd->child[0] = p2;
-	printNd->child[0] = p3;
+	setChild(readNd, 0, p1);
+	setChild(writeNd, 0, p2);
+	setChild(printNd, 0, p3);
 
 	st_insert_dcl(readNd, info->symbolTable);
 	st_insert_dcl(writeNd, info->symbolTable);
 	st_insert_dcl(printNd, info->symbolTable);
 }
 
+/* What the traversals hand to every visit */
+typedef struct traverseData
+{
+	Bool *errorFound;
+	SymbolTable *(*pre_proc)(TreeNode *, SymbolTable *, Bool *);
+	void (*post_proc)(TreeNode *, Bool *);
+} TraverseData;
+
+static void *pre_visit(TreeNode *t, void *st, void *data)
+{
+	TraverseData *d = (TraverseData *)data;
+	return d->pre_proc(t, (SymbolTable *)st, d->errorFound);
+}
+
+static void post_visit(TreeNode *t, void *context, void *data)
+{
+	TraverseData *d = (TraverseData *)data;
+	(void)context;
+	d->post_proc(t, d->errorFound);
+}
+
 /*  pre_traverse()
 	[Computation]:
-	- It is a generic recursive syntax tree traversal routine: it applies pre_proc in preorder to the tree pointed to by t.
+	- It is a generic syntax tree traversal routine: it applies pre_proc in preorder to the tree pointed to by t.
+	- The children of a node get the symbol table pre_proc returns for it; its siblings get st.
+	- traverseTree() keeps its stack on the heap, so a long statement list does not overflow the C stack.
 	[Preconditions]:
 	- st is not NULL.
  */
@@ -109,47 +120,42 @@ static void pre_traverse(TreeNode *t, SymbolTable *st, Bool *errorFound, SymbolT
 {
 	if (A_debugAnalyzer)
 		printf("%20s \n", __FUNCTION__);
-	if (t != NULL)
-	{
-		SymbolTable *newSt = pre_proc(t, st, errorFound);
-		for (int i = 0; i < MAX_CHILDREN; i++)
-			pre_traverse(t->child[i], newSt, errorFound, pre_proc);
-		pre_traverse(t->rSibling, st, errorFound, pre_proc);
-	}
+	TraverseData d = {errorFound, pre_proc, NULL};
+	traverseTree(t, st, pre_visit, NULL, &d);
 }
 
 /*  post_traverse()
 	[Computation]:
-	- It is a generic recursive syntax tree traversal routine: it applies post_proc in post-order to the tree pointed to by t.
+	- It is a generic syntax tree traversal routine: it applies post_proc in post-order to the tree pointed to by t.
  */
 static void post_traverse(TreeNode *t, Bool *errorFound, void (*post_proc)(TreeNode *, Bool *))
 {
 	if (A_debugAnalyzer)
 		printf("%20s \n", __FUNCTION__);
-	if (t != NULL)
-	{
-		for (int i = 0; i < MAX_CHILDREN; i++)
-			post_traverse(t->child[i], errorFound, post_proc);
-		post_proc(t, errorFound);
-		post_traverse(t->rSibling, errorFound, post_proc);
-	}
+	TraverseData d = {errorFound, NULL, post_proc};
+	traverseTree(t, NULL, NULL, post_visit, &d);
 }
 
-static Bool is_keyword(const char *name)
+static Bool is_keyword(Symbol name)
 {
 	if (A_debugAnalyzer)
 		printf("%20s \n", __FUNCTION__);
-	if ((strcmp(name, "if") == 0) ||
-		(strcmp(name, "else") == 0) ||
-		(strcmp(name, "while") == 0) ||
-		(strcmp(name, "num") == 0) ||
-		(strcmp(name, "void") == 0) ||
-		(strcmp(name, "return") == 0))
+	/* the same perfect hash the scanner uses for identifiers */
+	if (keywordType(symbolName(name), symbolLength(name)) != ID)
 		return TRUE;
 	else
 		return FALSE;
 }
 
+/* insert_ref()
+	Record the reference nd to the declaration in bk, and give nd the declared type:
+	that of the variable, of an element of the array, or the return type of the function. */
+static void insert_ref(TreeNode *nd, BucketList bk)
+{
+	st_insert_ref(nd, bk);
+	nd->type = bk->nd->type;
+}
+
 /* pre_proc()
 [Parameters]:
 - nd is node in the syntax tree.
@@ -178,24 +184,24 @@ static SymbolTable *pre_proc(TreeNode *nd, SymbolTable *st, Bool *errorFound)
 	switch (nd->nodeKind)
 	{
 	case STMT_ND:
-		switch (nd->kind.stmt)
+		switch (nd->kind)
 		{
 		case CMPD_STMT:					  // Compound statement
 			st = st_attach(st);			  // Create a new symbol table for the new block
-			nd->attr.dclAttr.symbol = st; // Attach the new symbol table to the node
+			setNodeScope(nd, st); // Attach the new symbol table to the node
 			break;
 		default:
 			break;
 		}
 		break;
 	case DCL_ND:
-		switch (nd->kind.dcl)
+		switch (nd->kind)
 		{
 		case VAR_DCL:
-			if (st_lookup(st, nd->attr.dclAttr.name) != NULL)
+			if (st_lookup(st, nd->name) != NULL)
 			{
 				fprintf(stderr, "Error: '%s' already declared in this scope (Line %d)\n",
-						nd->attr.dclAttr.name, nd->lineNum);
+						symbolName(nd->name), nd->lineNum);
 				*errorFound = TRUE;
 			}
 			else
@@ -204,10 +210,10 @@ static SymbolTable *pre_proc(TreeNode *nd, SymbolTable *st, Bool *errorFound)
 			}
 			break;
 		case ARRAY_DCL:
-			if (st_lookup(st, nd->attr.dclAttr.name) != NULL)
+			if (st_lookup(st, nd->name) != NULL)
 			{
 				fprintf(stderr, "Error: '%s' already declared in this scope (Line %d)\n",
-						nd->attr.dclAttr.name, nd->lineNum);
+						symbolName(nd->name), nd->lineNum);
 				*errorFound = TRUE;
 			}
 			else
@@ -216,65 +222,76 @@ static SymbolTable *pre_proc(TreeNode *nd, SymbolTable *st, Bool *errorFound)
 			}
 			break;
 		case FUN_DCL:
-			if (st_lookup(st, nd->attr.dclAttr.name) != NULL)
+			if (st_lookup(st, nd->name) != NULL)
 			{
 				fprintf(stderr, "Error: '%s' already declared in this scope (Line %d)\n",
-						nd->attr.dclAttr.name, nd->lineNum);
+						symbolName(nd->name), nd->lineNum);
 				*errorFound = TRUE;
 			}
 			else
 			{
 				st_insert_dcl(nd, st);
 			}
+			st = st_attach(st); // 参数和函数体在函数自己的符号表里
 			break;
 		default:
 			break;
 		}
 		break;
+	case PARAM_ND:
+		if (nd->kind != VOID_PARAM)
+		{
+			if (st_lookup(st, nd->name) != NULL)
+			{
+				fprintf(stderr, "Error: '%s' already declared in this scope (Line %d)\n",
+						symbolName(nd->name), nd->lineNum);
+				*errorFound = TRUE;
+			}
+			else
+			{
+				st_insert_dcl(nd, st);
+			}
+		}
+		break;
 	case EXPR_ND:
-		switch (nd->kind.expr)
+		switch (nd->kind)
 		{
 		case ID_EXPR:
-			if (is_keyword(nd->attr.exprAttr.name))
+			if (is_keyword(nd->name))
 			{
-				fprintf(stderr, "Error: '%s' is a keyword (Line %d)\n", nd->attr.exprAttr.name, nd->lineNum);
+				fprintf(stderr, "Error: '%s' is a keyword (Line %d)\n", symbolName(nd->name), nd->lineNum);
 				*errorFound = TRUE;
 			}
-			else if (st_lookup(st, nd->attr.exprAttr.name) == NULL)
+			else if (st_lookup(st, nd->name) == NULL)
 			{
-				fprintf(stderr, "Error: Identifier '%s' not declared (Line %d)\n", nd->attr.exprAttr.name, nd->lineNum);
+				fprintf(stderr, "Error: Identifier '%s' not declared (Line %d)\n", symbolName(nd->name), nd->lineNum);
 				*errorFound = TRUE;
 			}
 			else
 			{
-				st_insert_ref(nd, st_lookup(st, nd->attr.exprAttr.name));
+				insert_ref(nd, st_lookup(st, nd->name));
 			}
 			break;
 		case ARRAY_EXPR:
-			if (st_lookup(st, nd->attr.exprAttr.name) == NULL)
+			if (st_lookup(st, nd->name) == NULL)
 			{
-				fprintf(stderr, "Error: Array '%s' not declared (Line %d)\n", nd->attr.exprAttr.name, nd->lineNum);
+				fprintf(stderr, "Error: Array '%s' not declared (Line %d)\n", symbolName(nd->name), nd->lineNum);
 				*errorFound = TRUE;
 			}
 			else
 			{
-				if (nd->child[0]->type != INT_TYPE)
-				{
-					fprintf(stderr, "Error: Array index must be an integer (Line %d)\n", nd->lineNum);
-					*errorFound = TRUE;
-				}
-				st_insert_ref(nd, st_lookup(st, nd->attr.exprAttr.name));
+				insert_ref(nd, st_lookup(st, nd->name)); // 下标的类型在 post_proc() 中检查
 			}
 			break;
 		case CALL_EXPR:
-			if (st_lookup(st, nd->attr.exprAttr.name) == NULL)
+			if (st_lookup(st, nd->name) == NULL)
 			{
-				fprintf(stderr, "Error: Identifier '%s' not declared (Line %d)\n", nd->attr.exprAttr.name, nd->lineNum);
+				fprintf(stderr, "Error: Identifier '%s' not declared (Line %d)\n", symbolName(nd->name), nd->lineNum);
 				*errorFound = TRUE;
 			}
 			else
 			{
-				st_insert_ref(nd, st_lookup(st, nd->attr.exprAttr.name));
+				insert_ref(nd, st_lookup(st, nd->name));
 			}
 			break;
 		default:
@@ -285,16 +302,30 @@ static SymbolTable *pre_proc(TreeNode *nd, SymbolTable *st, Bool *errorFound)
 		break;
 	}
 
-	// Process children nodes
-	for (int i = 0; i < MAX_CHILDREN; i++)
+	// 子节点和兄弟节点由 pre_traverse() 访问
+	return st;
+}
+
+/* enclosing_function_type()
+	The declared type of the function nd is in. A node knows its parent only
+	if it is the first of its siblings, so the walk goes back along the
+	siblings first. */
+static ExprType enclosing_function_type(TreeNode *nd)
+{
+	while (nd != NULL && !(nd->nodeKind == DCL_ND && nd->kind == FUN_DCL))
 	{
-		st = pre_proc(nd->child[i], st, errorFound);
+		TreeNode *up = nodeParent(nd);
+		nd = up != NULL ? up : nodePrevSibling(nd);
 	}
+	return nd != NULL ? nd->type : VOID_TYPE;
+}
 
-	// Process sibling nodes
-	st = pre_proc(nd->rSibling, st, errorFound);
-
-	return st;
+/* return_type()
+	The type a return statement gives back: that of its value, void without one. */
+static ExprType return_type(TreeNode *nd)
+{
+	TreeNode *value = nodeChild(nd, 0);
+	return value != NULL ? value->type : VOID_TYPE;
 }
 
 /* post_proc()
@@ -313,39 +344,46 @@ void post_proc(TreeNode *nd, Bool *errorFound)
 	if (nd == NULL)
 		return;
 
-	// 遍历子节点
-	for (int i = 0; i < MAX_CHILDREN; i++)
-	{
-		post_proc(nd->child[i], errorFound);
-	}
+	// 子节点已由 post_traverse() 先访问过
 
 	// 根据节点类型进行处理
 	switch (nd->nodeKind)
 	{
 	case EXPR_ND:
-		switch (nd->kind.expr)
+		switch (nd->kind)
 		{
 		case ASN_EXPR:
-			// 检查赋值表达式的左右类型是否匹配
-			if (!checkType(nd->attr.exprAttr.token, nd->attr.exprAttr.op))
+			// 检查赋值表达式的左右类型是否匹配（见上面 x = e 的例子）。
+			// 原来比较节点的 Token 指针和 op，但解析器从不设置那个指针，每个赋值都会报错；
+			// 节点里也不再有 Token，所以直接比较左右两边的类型
+			if (nodeChild(nd, 0) != NULL && nodeChild(nd, 1) != NULL &&
+				nodeChild(nd, 0)->type != nodeChild(nd, 1)->type)
 			{
 				printf("Error: Type mismatch in assignment at line %d\n", nd->lineNum);
 			}
 			break;
+		case ARRAY_EXPR:
+			// 检查数组下标是否为整型；先序遍历时下标的类型还没有确定
+			if (nodeChild(nd, 0) != NULL && nodeChild(nd, 0)->type != INT_TYPE)
+			{
+				fprintf(stderr, "Error: Array index must be an integer (Line %d)\n", nd->lineNum);
+				*errorFound = TRUE;
+			}
+			break;
 		case OP_EXPR:
 			// 根据操作符更新表达式类型
-			if (nd->attr.exprAttr.op == PLUS || nd->attr.exprAttr.op == MINUS)
+			if (nd->op == PLUS || nd->op == MINUS)
 			{
 				nd->type = INT_TYPE;
 			}
-			else if (nd->attr.exprAttr.op == LT || nd->attr.exprAttr.op == GT ||
-					 nd->attr.exprAttr.op == EQ || nd->attr.exprAttr.op == UNEQ)
+			else if (nd->op == LT || nd->op == GT ||
+					 nd->op == EQ || nd->op == UNEQ)
 			{
 				nd->type = INT_TYPE;
 			}
-			else if (nd->attr.exprAttr.op == MUL || nd->attr.exprAttr.op == DIV)
+			else if (nd->op == MUL || nd->op == DIV)
 			{
-				if (nd->child[0]->type == INT_TYPE && nd->child[1]->type == INT_TYPE)
+				if (nodeChild(nd, 0)->type == INT_TYPE && nodeChild(nd, 1)->type == INT_TYPE)
 				{
 					nd->type = INT_TYPE;
 				}
@@ -360,60 +398,60 @@ void post_proc(TreeNode *nd, Bool *errorFound)
 		}
 		break;
 	case STMT_ND:
-		switch (nd->kind.stmt)
+		switch (nd->kind)
 		{
 		case RTN_STMT:
-			// 检查返回语句的类型是否正确
-			if (!checkType(nd->attr.exprAttr.token, nd->child[0]->type == RETURN_TYPE))
+			// 检查返回语句的类型是否正确：返回值和函数声明的类型比较，没有返回值时为 void
+			if (return_type(nd) != enclosing_function_type(nd))
 			{
 				printf("Error: Type mismatch in return statement at line %d\n", nd->lineNum);
 			}
 			break;
 		case WHILE_STMT:
 			// 检查 while 语句的条件是否为整型
-			if (nd->child[0]->type != INT_TYPE)
+			if (nodeChild(nd, 0)->type != INT_TYPE)
 			{
 				printf("Error: Condition in while statement must be an integer (Line %d)\n", nd->lineNum);
 			}
 			break;
 		case FOR_STMT:
 			// 检查 for 语句的条件是否为整型
-			if (nd->child[0]->type != INT_TYPE)
+			if (nodeChild(nd, 0)->type != INT_TYPE)
 			{
 				printf("Error: Condition in for statement must be an integer (Line %d)\n", nd->lineNum);
 			}
 			break;
 		case SLCT_STMT:
 			// 检查 if 语句的条件是否为整型
-			if (nd->child[0]->type != INT_TYPE)
+			if (nodeChild(nd, 0)->type != INT_TYPE)
 			{
 				printf("Error: Condition in if statement must be an integer (Line %d)\n", nd->lineNum);
 			}
 			break;
 		case EXPR_STMT:
 			// 检查表达式语句的类型是否正确
-			if (nd->child[0]->type != VOID_TYPE)
+			if (nodeChild(nd, 0)->type != VOID_TYPE)
 			{
 				printf("Error: Expression statement must be void (Line %d)\n", nd->lineNum);
 			}
 			break;
 		case CMPD_STMT:
 			// 检查复合语句的类型是否正确
-			if (nd->child[0]->type != VOID_TYPE)
+			if (nodeChild(nd, 0)->type != VOID_TYPE)
 			{
 				printf("Error: Compound statement must be void (Line %d)\n", nd->lineNum);
 			}
 			break;
 		case NULL_STMT:
 			// 检查空语句的类型是否正确
-			if (nd->child[0]->type != VOID_TYPE)
+			if (nodeChild(nd, 0)->type != VOID_TYPE)
 			{
 				printf("Error: Null statement must be void (Line %d)\n", nd->lineNum);
 			}
 			break;
 		case DO_WHILE_STMT:
 			// 检查 do while 语句的条件是否为整型
-			if (nd->child[0]->type != INT_TYPE)
+			if (nodeChild(nd, 0)->type != INT_TYPE)
 			{
 				printf("Error: Condition in do while statement must be an integer (Line %d)\n", nd->lineNum);
 			}
@@ -426,8 +464,6 @@ void post_proc(TreeNode *nd, Bool *errorFound)
 		break;
 	}
 
-	// 处理兄弟节点
-	post_proc(nd->rSibling, errorFound);
 }
 
 /*  build_symbol_table()
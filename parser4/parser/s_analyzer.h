@@ -39,7 +39,7 @@ static void post_traverse(TreeNode *t, Bool *errorFound, void (*post_proc)(TreeN
 static SymbolTable *pre_proc(TreeNode *nd, SymbolTable *st, Bool *errorFound);
 static void post_proc(TreeNode *nd, Bool *errorFound);
 static void semantic_error(const TreeNode *nd, int errorNum, Bool *errorFound);
-static Bool is_keyword(const char *name);
+static Bool is_keyword(Symbol name);
 typedef struct analyzer Analyzer;
 
 void destroyAnalyzer(Analyzer *self);
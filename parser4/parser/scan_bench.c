@@ -0,0 +1,156 @@
+/****************************************************
+ File: scan_bench.c
+
+ Microbenchmark of the scanner.
+ Usage: scan_bench [-t threads] [file ...]
+
+ Scans each input with tokenizeBuffer() at every skip level the CPU
+ supports (scalar, SSE2, AVX2), then with tokenizeBufferParallel() on 1 to
+ threads threads (default: one per online CPU), and prints the throughput
+ in MB/s. Without files it scans three generated inputs: comment heavy,
+ string heavy and blank heavy.
+ ****************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "scanner.h"
+#include "scan_skip.h"
+
+#define BENCH_BYTES (16 * 1024 * 1024)
+#define BENCH_ROUNDS 5
+
+static const char *levelNames[] = {"scalar", "sse2", "avx2"};
+
+static double now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Repeat line until the buffer holds about BENCH_BYTES. */
+static char *generate(const char *line, size_t *len)
+{
+    size_t n = strlen(line);
+    size_t count = BENCH_BYTES / n;
+    char *text = (char *)malloc(count * n);
+    if (text == NULL)
+    {
+        fprintf(stderr, "scan_bench: out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++)
+        memcpy(text + i * n, line, n);
+    *len = count * n;
+    return text;
+}
+
+static char *readAll(const char *filename, size_t *len)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        perror(filename);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = (char *)malloc(size > 0 ? size : 1);
+    *len = fread(text, 1, size, file);
+    fclose(file);
+    return text;
+}
+
+static void bench(const char *name, const char *text, size_t len)
+{
+    SkipLevel best = setSkipLevel(SKIP_AVX2);
+    for (int lv = SKIP_SCALAR; lv <= (int)best; lv++)
+    {
+        setSkipLevel((SkipLevel)lv);
+        double fastest = 1e30;
+        int tokens = 0;
+        for (int round = 0; round < BENCH_ROUNDS; round++)
+        {
+            List list;
+            initList(&list);
+            double t0 = now();
+            tokenizeBuffer(&list, text, len);
+            double t = now() - t0;
+            if (t < fastest)
+                fastest = t;
+            tokens = list.size;
+            freeList(&list);
+        }
+        printf("%-10s %-7s %10.1f MB/s  (%d tokens)\n", name, levelNames[lv], len / fastest / 1e6, tokens);
+    }
+}
+
+/* Scaling of the parallel scanner from 1 to maxThreads threads. */
+static void benchThreads(const char *name, const char *text, size_t len, int maxThreads)
+{
+    double single = 0;
+    for (int threads = 1; threads <= maxThreads; threads++)
+    {
+        double fastest = 1e30;
+        for (int round = 0; round < BENCH_ROUNDS; round++)
+        {
+            List list;
+            initList(&list);
+            double t0 = now();
+            tokenizeBufferParallel(&list, text, len, threads);
+            double t = now() - t0;
+            if (t < fastest)
+                fastest = t;
+            freeList(&list);
+        }
+        if (threads == 1)
+            single = fastest;
+        printf("%-10s %2d threads %10.1f MB/s  (x%.2f)\n", name, threads, len / fastest / 1e6, single / fastest);
+    }
+}
+
+static void benchAll(const char *name, const char *text, size_t len, int maxThreads)
+{
+    bench(name, text, len);
+    benchThreads(name, text, len, maxThreads);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t len;
+    char *text;
+    int maxThreads = scanThreads();
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-t") == 0)
+    {
+        maxThreads = atoi(argv[2]);
+        first = 3;
+    }
+    if (argc > first)
+    {
+        for (int i = first; i < argc; i++)
+        {
+            text = readAll(argv[i], &len);
+            benchAll(argv[i], text, len, maxThreads);
+            free(text);
+        }
+        return 0;
+    }
+
+    text = generate("x = 1; # a line comment that runs on for a while before it finally ends here\n"
+                    "/* a block comment\n   that spans two lines and says nothing useful at all */\n",
+                    &len);
+    benchAll("comments", text, len, maxThreads);
+    free(text);
+
+    text = generate("print(\"a string literal with enough text in it to be worth skipping fast\");\n", &len);
+    benchAll("strings", text, len, maxThreads);
+    free(text);
+
+    text = generate("a                                   =                                 b;\n", &len);
+    benchAll("blanks", text, len, maxThreads);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/****************************************************
+ File: scan_skip.c
+
+ SIMD kernels for the scanner's skip loops. The SSE2 versions compare 16
+ bytes at a time and the AVX2 versions 32; a movemask of the comparison
+ gives the offset of the first hit. The tail shorter than one vector is
+ finished by the scalar version. Vector kernels are built only for x86
+ with GCC or Clang (target attributes + __builtin_cpu_supports); other
+ compilers and CPUs use the scalar kernels.
+ ****************************************************/
+#include "scan_skip.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SKIP_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+static int isBlank(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static const char *skipToEither_scalar(const char *p, const char *end, char a, char b)
+{
+    while (p < end && *p != a && *p != b)
+        p++;
+    return p;
+}
+
+static const char *skipBlanks_scalar(const char *p, const char *end)
+{
+    while (p < end && isBlank((unsigned char)*p))
+        p++;
+    return p;
+}
+
+static size_t countNewlines_scalar(const char *p, const char *end)
+{
+    size_t n = 0;
+    for (; p < end; p++)
+        n += (*p == '\n');
+    return n;
+}
+
+#ifdef SKIP_HAVE_X86
+__attribute__((target("sse2"))) static const char *skipToEither_sse2(const char *p, const char *end, char a, char b)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    while (end - p >= 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)p);
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)));
+        if (m)
+            return p + __builtin_ctz(m);
+        p += 16;
+    }
+    return skipToEither_scalar(p, end, a, b);
+}
+
+/* blank: c == ' ' or 9 <= c <= 13 except '\n' */
+__attribute__((target("sse2"))) static const char *skipBlanks_sse2(const char *p, const char *end)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i four = _mm_set1_epi8(4);
+    while (end - p >= 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)p);
+        __m128i t = _mm_sub_epi8(x, nine);
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(t, four), t);
+        __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(x, space),
+                                     _mm_andnot_si128(_mm_cmpeq_epi8(x, newline), control));
+        int m = _mm_movemask_epi8(blank) ^ 0xFFFF;
+        if (m)
+            return p + __builtin_ctz(m);
+        p += 16;
+    }
+    return skipBlanks_scalar(p, end);
+}
+
+__attribute__((target("sse2"))) static size_t countNewlines_sse2(const char *p, const char *end)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t n = 0;
+    while (end - p >= 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)p);
+        n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(x, newline)));
+        p += 16;
+    }
+    return n + countNewlines_scalar(p, end);
+}
+
+__attribute__((target("avx2"))) static const char *skipToEither_avx2(const char *p, const char *end, char a, char b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    while (end - p >= 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)p);
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb)));
+        if (m)
+            return p + __builtin_ctz(m);
+        p += 32;
+    }
+    return skipToEither_sse2(p, end, a, b);
+}
+
+__attribute__((target("avx2"))) static const char *skipBlanks_avx2(const char *p, const char *end)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i four = _mm256_set1_epi8(4);
+    while (end - p >= 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)p);
+        __m256i t = _mm256_sub_epi8(x, nine);
+        __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t);
+        __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(x, space),
+                                        _mm256_andnot_si256(_mm256_cmpeq_epi8(x, newline), control));
+        unsigned m = ~(unsigned)_mm256_movemask_epi8(blank);
+        if (m)
+            return p + __builtin_ctz(m);
+        p += 32;
+    }
+    return skipBlanks_sse2(p, end);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t countNewlines_avx2(const char *p, const char *end)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t n = 0;
+    while (end - p >= 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)p);
+        n += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, newline)));
+        p += 32;
+    }
+    return n + countNewlines_sse2(p, end);
+}
+#endif
+
+typedef struct
+{
+    const char *(*toEither)(const char *, const char *, char, char);
+    const char *(*blanks)(const char *, const char *);
+    size_t (*newlines)(const char *, const char *);
+} SkipKernels;
+
+static const SkipKernels kernels[] = {
+    {skipToEither_scalar, skipBlanks_scalar, countNewlines_scalar},
+#ifdef SKIP_HAVE_X86
+    {skipToEither_sse2, skipBlanks_sse2, countNewlines_sse2},
+    {skipToEither_avx2, skipBlanks_avx2, countNewlines_avx2},
+#endif
+};
+
+static int level = -1; // chosen on first use
+
+static SkipLevel bestLevel(void)
+{
+#ifdef SKIP_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SKIP_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SKIP_SSE2;
+#endif
+    return SKIP_SCALAR;
+}
+
+/* skipLevel()
+   The kernels in use, chosen on the first call. That call writes level,
+   so it must not race: tokenizeBufferParallel() makes it before it
+   starts its workers. */
+SkipLevel skipLevel(void)
+{
+    if (level < 0)
+        level = bestLevel();
+    return (SkipLevel)level;
+}
+
+SkipLevel setSkipLevel(SkipLevel wanted)
+{
+    SkipLevel best = bestLevel();
+    level = wanted < best ? wanted : best;
+    return (SkipLevel)level;
+}
+
+const char *skipToEither(const char *p, const char *end, char a, char b)
+{
+    return kernels[skipLevel()].toEither(p, end, a, b);
+}
+
+const char *skipBlanks(const char *p, const char *end)
+{
+    return kernels[skipLevel()].blanks(p, end);
+}
+
+size_t countNewlines(const char *p, const char *end)
+{
+    return kernels[skipLevel()].newlines(p, end);
+}
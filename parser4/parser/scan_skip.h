@@ -0,0 +1,28 @@
+#ifndef SCAN_SKIP_H
+#define SCAN_SKIP_H
+#include <stddef.h>
+
+/* Fast paths used by the scanner for the long runs it does not tokenize
+   (comment bodies, string literal bodies and blanks) and for counting
+   lines. Each kernel exists in a scalar, an SSE2 and an AVX2 version; the
+   best one the CPU supports is picked on first use. */
+typedef enum
+{
+  SKIP_SCALAR,
+  SKIP_SSE2,
+  SKIP_AVX2
+} SkipLevel;
+
+SkipLevel skipLevel(void);               // kernels in use
+SkipLevel setSkipLevel(SkipLevel level); // force a level (benchmarks); clamped to what the CPU supports
+
+/* First byte in [p, end) equal to a or b, or end if there is none. */
+const char *skipToEither(const char *p, const char *end, char a, char b);
+
+/* First byte in [p, end) that is not ' ', '\t', '\r', '\v' or '\f', or end. */
+const char *skipBlanks(const char *p, const char *end);
+
+/* Number of '\n' in [p, end). */
+size_t countNewlines(const char *p, const char *end);
+
+#endif
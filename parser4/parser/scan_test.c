@@ -0,0 +1,159 @@
+/****************************************************
+ File: scan_test.c
+
+ Regression test of the parallel scanner.
+ Usage: scan_test
+
+ Generates TEST_BYTES of input for each of TEST_SEEDS seeds: tokens of
+ every kind, comments, line ends and indentation, bad text that gives
+ diagnostics, and block comments and multi-line strings long enough to
+ cross the line boundaries tokenizeBufferParallel() cuts its chunks at.
+ Each input is scanned with tokenizeBuffer() and with
+ tokenizeBufferParallel() on each of testThreads[] threads; the lists
+ must be the same: tokens, trivia, literal values and diagnostics.
+ Exits with 1 if any differs.
+ ****************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scanner.h"
+
+#define TEST_BYTES (4 * 1024 * 1024)
+#define TEST_SEEDS 3
+
+static const int testThreads[] = {2, 5, 8};
+
+static const char *pieces[] = {
+    "x", "count12", "while", "if", "else", "return", "int", "frac", "str", "void",
+    "0", "42", "3:4", "12:8", "99999999999999999999999", // the last does not fit: a diagnostic
+    "+", "-", "*", "/", "%", "++", "--", "**", "<", "<=", "==", "!=", "&&", "||",
+    "=", "+=", "**=", "<<", ">>", "(", ")", "[", "]", "{", "}", ";", ",", ":",
+    " ", "  ", "\t",
+    "\n", "\n", "\n", "\n    ", "\n        ", "\n\t", "\n  ", "\r\n",
+    "// line comment", "# hash comment", "/* short */", "/* two\n lines */",
+    "\"string\"", "\"two\n lines\"", "\"open", "@", "$",
+};
+
+static unsigned long seedState;
+
+static unsigned next(void)
+{
+    seedState = seedState * 6364136223846793005UL + 1442695040888963407UL;
+    return (unsigned)(seedState >> 33);
+}
+
+/* Append a block comment or a string of about size bytes over many lines. */
+static size_t longPiece(char *text, size_t size)
+{
+    int comment = next() & 1;
+    size_t len = 0;
+    text[len++] = comment ? '/' : '"';
+    if (comment)
+        text[len++] = '*';
+    while (len < size)
+    {
+        static const char line[] = " some words on a line, with * and / and \\\" in them\n";
+        memcpy(text + len, line, sizeof(line) - 1);
+        len += sizeof(line) - 1;
+    }
+    if (comment)
+        text[len++] = '*';
+    text[len++] = comment ? '/' : '"';
+    return len;
+}
+
+static char *generate(unsigned seed, size_t *len)
+{
+    char *text = (char *)malloc(TEST_BYTES + 1024 * 1024);
+    if (text == NULL)
+    {
+        fprintf(stderr, "scan_test: out of memory\n");
+        exit(1);
+    }
+    seedState = seed;
+    size_t n = 0;
+    while (n < TEST_BYTES)
+    {
+        unsigned r = next();
+        if (r % 20000 == 0)
+            n += longPiece(text + n, 64 * 1024 + next() % (256 * 1024));
+        else
+        {
+            const char *piece = pieces[r % (sizeof(pieces) / sizeof(pieces[0]))];
+            size_t k = strlen(piece);
+            memcpy(text + n, piece, k);
+            n += k;
+            if (next() % 2)
+                text[n++] = ' ';
+        }
+    }
+    *len = n;
+    return text;
+}
+
+#define SAME_ARRAY(field, count) \
+    (memcmp(a->field, b->field, (size_t)(count) * sizeof(a->field[0])) == 0)
+
+/* The first difference between a and b, or NULL. */
+static const char *difference(List *a, List *b)
+{
+    if (a->size != b->size)
+        return "token count";
+    if (!SAME_ARRAY(type, a->size) || !SAME_ARRAY(offset, a->size) || !SAME_ARRAY(length, a->size))
+        return "tokens";
+    if (!SAME_ARRAY(aux, a->size))
+        return "aux";
+    if (!SAME_ARRAY(triviaEnd, a->size))
+        return "triviaEnd";
+    if (a->triviaCount != b->triviaCount || !SAME_ARRAY(triviaType, a->triviaCount) ||
+        !SAME_ARRAY(triviaOffset, a->triviaCount) || !SAME_ARRAY(triviaLength, a->triviaCount))
+        return "trivia";
+    for (int i = 0; i < a->size; i++)
+    {
+        Rational x = tokenValue(a, i), y = tokenValue(b, i);
+        if (x.num != y.num || x.den != y.den)
+            return "literal values";
+    }
+    if (a->diagCount != b->diagCount)
+        return "diagnostic count";
+    for (int i = 0; i < a->diagCount; i++)
+    {
+        if (a->diag[i].code != b->diag[i].code || a->diag[i].offset != b->diag[i].offset ||
+            strcmp(a->diag[i].message, b->diag[i].message) != 0)
+            return "diagnostics";
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    int failures = 0;
+    for (unsigned seed = 1; seed <= TEST_SEEDS; seed++)
+    {
+        size_t len;
+        char *text = generate(seed, &len);
+        List serial;
+        initList(&serial);
+        ScanStatus serialStatus = tokenizeBuffer(&serial, text, len);
+        for (size_t k = 0; k < sizeof(testThreads) / sizeof(testThreads[0]); k++)
+        {
+            List parallel;
+            initList(&parallel);
+            ScanStatus status = tokenizeBufferParallel(&parallel, text, len, testThreads[k]);
+            const char *what = status != serialStatus ? "status" : difference(&serial, &parallel);
+            if (what != NULL)
+            {
+                fprintf(stderr, "scan_test: seed %u, %d threads: %s differ from tokenizeBuffer()\n",
+                        seed, testThreads[k], what);
+                failures++;
+            }
+            freeList(&parallel);
+        }
+        printf("scan_test: seed %u: %zu bytes, %d tokens, %d diagnostics\n",
+               seed, len, serial.size, serial.diagCount);
+        freeList(&serial);
+        free(text);
+    }
+    internFree();
+    return failures > 0;
+}
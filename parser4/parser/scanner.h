@@ -2,6 +2,10 @@
 #define SCANNER_H
 #include <stdio.h>
 #include <stdlib.h>
+#include "intern.h"
+#include "rational.h"
+#include "arena.h"
+#include "error_handler.h"
 typedef enum
 {
   START,
@@ -10,67 +14,79 @@ typedef enum
   ERROR_STATE
 
 } State;
+/* The token list. Each entry is X(name, spelling), where spelling is the fixed
+   text of an operator, a punctuation mark or a keyword, and NULL for tokens
+   whose text varies. TokenType, tokenTypeNames[] and the transition tables of
+   the scanner DFA (generated by gen_lexer_tables.c) are all built from it. */
+#define TOKEN_LIST(X)                    \
+  X(PLUS, "+")                           \
+  X(MINUS, "-")                          \
+  X(MUL, "*")                            \
+  X(DIV, "/")                            \
+  X(MOD, "%")                            \
+  X(PPLUS, "++")                         \
+  X(MMINUS, "--")                        \
+  X(POWER, "**")                         \
+  X(LT, "<")                             \
+  X(GT, ">")                             \
+  X(LTE, "<=")                           \
+  X(GTE, ">=")                           \
+  X(EQ, "==")                            \
+  X(UNEQ, "!=")                          \
+  X(AAND, "&&")                          \
+  X(OR, "||")                            \
+  X(OR1, "|")                            \
+  X(NOT, "!")                            \
+  X(ASSIGN, "=")                         \
+  X(PLUS_ASSIGN, "+=")                   \
+  X(MINUS_ASSIGN, "-=")                  \
+  X(MUL_ASSIGN, "*=")                    \
+  X(DIV_ASSIGN, "/=")                    \
+  X(MOD_ASSIGN, "%=")                    \
+  X(POWER_ASSIGN, "**=")                 \
+  X(AND, "&")                            \
+  X(LEFT_SHIFT, "<<")                    \
+  /*operators + - * / % ++ -- ** < > <= >= == != && || ! = += -= *= /= %= **= & << >> ,? : ,sizeof */ \
+  X(RIGHT_SHIFT, ">>")                   \
+  X(INT, "int")                          \
+  X(FRAC, "frac")                        \
+  X(STR, "str")                          \
+  X(VOID, "void")                        \
+  X(ID, NULL)                            \
+  X(INTL, NULL)                          \
+  X(FRACL, NULL)                         \
+  X(STRL, NULL) /* literal */            \
+  X(LCUR, "{")                           \
+  X(RCUR, "}")                           \
+  X(LPAR, "(")                           \
+  X(RPAR, ")")                           \
+  X(LBRA, "[")                           \
+  X(RBRA, "]") /* { } ( ) [ ] */         \
+  X(NEWLINE, NULL)                       \
+  X(COLON, ":")                          \
+  X(SEMI, ";")                           \
+  X(COMMA, ",") /* \n : ; , */          \
+  X(INDENT, NULL) /* 缩进 */              \
+  X(DEDENT, NULL) /* 缩进结束 */           \
+  X(COMMENT, NULL) /* 注释 */             \
+  X(DO, "do")                            \
+  X(WHILE, "while")                      \
+  X(FOR, "for")                          \
+  X(DEF, NULL) /* "def" scans as an ID */ \
+  X(RETURN, "return")                    \
+  X(IN, "in")                            \
+  X(IF, "if")                            \
+  X(ELIF, "elif")                        \
+  X(ELSE, "else")                        \
+  X(ERROR, NULL)                         \
+  X(END_OF_FILE, NULL) /* end of file */
+
 typedef enum tokentype
 {
-  PLUS,
-  MINUS,
-  MUL,
-  DIV,
-  MOD,
-  PPLUS,
-  MMINUS,
-  POWER,
-  LT,
-  GT,
-  LTE,
-  GTE,
-  EQ,
-  UNEQ,
-  AAND,
-  OR,
-  OR1,
-  NOT,
-  ASSIGN,
-  PLUS_ASSIGN,
-  MINUS_ASSIGN,
-  MUL_ASSIGN,
-  DIV_ASSIGN,
-  MOD_ASSIGN,
-  POWER_ASSIGN,
-  AND,
-  LEFT_SHIFT,
-  RIGHT_SHIFT, /*operators + - * / % ++ -- ** < > <= >= == != && || ! = += -= *= /= %= **= & << >> ,? : ,sizeof */
-  INT,
-  FRAC,
-  STR,
-  VOID,
-  ID,
-  INTL,
-  FRACL,
-  STRL, // literal
-  LCUR,
-  RCUR,
-  LPAR,
-  RPAR,
-  LBRA,
-  RBRA, // { } ( ) [ ]
-  NEWLINE,
-  COLON,
-  SEMI,
-  COMMA,   // \n : ; ,
-  INDENT,  // 缩进
-  COMMENT, // 注释
-  DO,
-  WHILE,
-  FOR,
-  DEF,
-  RETURN,
-  IN,
-  IF,
-  ELIF,
-  ELSE,
-  ERROR,
-  END_OF_FILE // end of file
+#define TOKEN_ENUM(name, spelling) name,
+  TOKEN_LIST(TOKEN_ENUM)
+#undef TOKEN_ENUM
+  TOKEN_COUNT
 } TokenType;
 extern const char *tokenTypeNames[];
 
@@ -79,39 +95,184 @@ typedef struct token
   TokenType type;
   char *info;
   int lineNum;
+  Symbol sym; // interned name of an ID, NO_SYMBOL otherwise
+  int width;  // INDENT, DEDENT: indentation width in effect after the token
+  Rational value; // INTL, FRACL: the exact value (see rational.h)
 } Token;
 
-typedef struct node
+/* A problem found in the input. The scanner does not stop for it: the bad
+   text becomes an ERROR token and scanning goes on at the next line. */
+typedef struct diagnostic
 {
-  Token *t; // Token* token;
-  struct node *next;
-  struct node *prev;
-  char *info;
-  TokenType type;
-  int lineNum;
-} Node;
+  ErrorCode code;
+  unsigned offset;     // where in the text (token lists only)
+  int lineNum;         // 0 in a token list until printDiagnostics() works it out
+  const char *message;
+} Diagnostic;
+
+/* How a scan went */
+typedef enum
+{
+  SCAN_OK,
+  SCAN_ERRORS, // the input has errors; see the diagnostics
+  SCAN_FAILED  // the input could not be read, or its text not held in memory; the list is empty
+} ScanStatus;
+
+/* Who releases List.text when the list is freed */
+typedef enum
+{
+  TEXT_BORROWED, // belongs to the caller of tokenizeBuffer()
+  TEXT_OWNED,    // malloc'd by the scanner
+  TEXT_MAPPED    // mmap'd by scanFile()
+} TextOwner;
+
+/* The token list is a growable struct-of-arrays: token i is
+   (type[i], offset[i], length[i], aux[i]) and is addressed by its index.
+   The value of an INTL or FRACL does not fit in aux: it is worked out when
+   the token is added and kept in the literal table, at index aux[i].
+   Line numbers are not stored per token: the first tokenLineNum() builds an
+   index of where each line of text starts and binary searches it.
+   Trivia (comments, line ends and raw indentation) are not tokens: they
+   sit in a side table, in text order; triviaEnd[i] is the number of
+   entries before token i, so the ones between tokens i - 1 and i are
+   [triviaEnd[i - 1], triviaEnd[i]). Tokens, trivia and the blanks between
+   them tile the text. */
 typedef struct list
 {
-  Node *head; // pointer to the first node
-  Node *tail; // pointer to the last node
-  int size;   // number of elements in the list
+  unsigned char *type; // TokenType of each token
+  unsigned *offset;    // the lexeme of token i is text[offset[i] .. offset[i] + length[i])
+  unsigned *length;
+  unsigned *aux;       // per-token payload: the interned Symbol of an ID, the width of an INDENT or DEDENT, the literal index of an INTL or FRACL, 0 otherwise
+  unsigned *triviaEnd;
+  char **info;         // lexeme copies made by tokenInfo(), NULL until first asked
+  int size;            // number of tokens
+  int capacity;        // number of slots allocated in each array
+  char *text;          // the source text that every token is a slice of
+  size_t textLen;
+  size_t textCap;
+  TextOwner textOwner;
+  unsigned char *triviaType; // COMMENT, NEWLINE or INDENT (the blanks that indent a line)
+  unsigned *triviaOffset;
+  unsigned *triviaLength;
+  int triviaCount;
+  int triviaCapacity;
+  Rational *literal;   // values of the INTL and FRACL tokens, in order
+  int literalCount;
+  int literalCapacity;
+  Diagnostic *diag;    // errors in the text, in order
+  int diagCount;
+  int diagCapacity;
+  unsigned *lineStart; // offset of the first byte of each line, NULL until first asked
+  int lineCount;
+  int lineCapacity;
+  Arena arena;         // the arrays above and the lexeme copies; freed in one go
 } List;
 
-void initList(List *list);                                   // 初始化链表
-void addToken(List *list, TokenType type, const char *info); // 添加token
-void tokenizeFile(List *list, FILE *file);                   // 识别文件中的token，并将其添加到链表中
+void initList(List *list);                                   // 初始化token表
+void reserveTokens(List *list, int capacity);                // 预留空间
+void addToken(List *list, TokenType type, size_t offset, size_t length); // 添加token（只记录在 text 中的位置）
+const char *tokenInfo(List *list, int index);                // 取得token的字符串，第一次调用时才复制
+Symbol tokenSymbol(List *list, int index);                   // ID 的标识符句柄，其他 token 为 NO_SYMBOL
+int tokenIndentWidth(List *list, int index);                 // INDENT/DEDENT 之后的缩进宽度
+Rational tokenValue(List *list, int index);                  // INTL/FRACL 的精确值（扫描时算好），其他 token 为 0/1
+int triviaBefore(List *list, int index, int *first);         // token 前面的注释、换行和缩进：返回个数，*first 为第一个
+int tokenStartsLine(List *list, int index);                  // token 是否为一行的第一个 token
+int tokenLineWidth(List *list, int index);                   // token 所在行的缩进宽度（off-side 规则所数的）
+void writeSource(List *list, FILE *out);                     // 由 token 和 trivia 还原源文件
+int tokenLineNum(List *list, int index);                     // token 所在行（第一次调用时建立行索引）
+int tokenColumn(List *list, int index);                      // token 所在列（字节，从 1 开始）
+int offsetLineNum(List *list, size_t offset);                // text 中 offset 处的行号
+ScanStatus tokenizeFile(List *list, FILE *file);             // 识别文件中的token，并将其添加到token表中
+ScanStatus tokenizeBuffer(List *list, const char *data, size_t len); // 同上，但直接遍历内存中的整个源文件
+ScanStatus tokenizeBufferParallel(List *list, const char *data, size_t len, int threads); // 同上，按行切块多线程扫描，结果与 tokenizeBuffer 相同
+void printDiagnostics(List *list, FILE *out);                // 打印扫描时记录的错误
+void setScanThreads(int threads);                            // scanFile 使用的线程数，0 表示每个 CPU 一个
+int scanThreads(void);
 TokenType identifyTokenType(const char *token);              //// 识别Token类型（重点写的部分）DFA function
-void printTokens(const List *list);                          // 打印token
-void freeList(List *list);                                   // 释放链表
-List *scanFile(const char *filename);
-#endif // SCANNER_H
+TokenType keywordType(const char *s, size_t n);              // 关键字返回其类型，否则返回 ID
+void printTokens(List *list);                                // 打印token
+void freeList(List *list);                                   // 释放token表（一次释放 arena）
+void deleteList(List *list);                                 // 释放 scanFile() 返回的token表，包括表头
+void printListStats(const List *list);                       // 统计模式：打印分配次数
+List *scanFile(const char *filename);                        // 用 deleteList() 释放；文件打不开或读不出来时返回 NULL
+List *scanBuffer(const char *data, size_t len);              // 同上，扫描内存中的源文件；data 须比链表活得久
+int editList(List *list, size_t start, size_t end, const char *text, size_t len, int *first, int last); // 把 [start, end) 换成 text[0..len)，只重新扫描 token *first 到 last 之间；返回 last 的新下标
 
-// Token* get_token(void); 没有参数，依赖某些全局变量（global variable）
-// Token* get_token_2(ScanEnv* info); 有参数，不依赖全局变量
-/*typedef struct scanEnv{
-  char* fileString;
-  int currentPos;
-} ScanEnv; 把一个文件中的全部内容读到一个字符串里面
-void print_token(const Token*);
-TokenNode* scan(void); 读取文件中的所有token，返回一个链表
-*/
\ No newline at end of file
+/* Where the scanner is: the current line and whether it is at the start of
+   one (where blanks are an INDENT rather than skipped). lineNum is only kept
+   up to date when trackLines is set. */
+typedef struct lexPos
+{
+  int lineNum;
+  int isStartOfLine;
+  ErrorCode errorCode;
+  const char *error; // why the last ERROR token is one
+  int trackLines;   // count the lines inside comments and string literals too
+} LexPos;
+
+/* The off-side rule. Lines are indented by a stack of widths: a line
+   indented deeper than the top pushes its width and gets an INDENT, one
+   indented less pops every deeper level with a DEDENT each, so the two
+   always balance. Blank and comment-only lines, and lines continued inside
+   ( ) or [ ], do not count. A { starts a frame whose base is the
+   indentation of its first line: plain C blocks give no INDENT at all,
+   and } closes what was opened inside the frame. */
+#define LAYOUT_MAX_DEPTH 100
+
+typedef struct indentLevel
+{
+  int width;  // -1 while a frame waits for its first line
+  int isBase; // set by { or the start of the input, not by an INDENT
+} IndentLevel;
+
+typedef struct layout
+{
+  IndentLevel stack[LAYOUT_MAX_DEPTH];
+  int depth;
+  int parens;          // open ( and [
+  int atLineStart;     // no token but indentation and comments on this line yet
+  int lineWidth;       // width of this line's indentation
+  int dedentTo;        // work due before the held token: pop levels deeper than this (-1: none)
+  int closeFrame;      // the held token is a }
+  int openFrame;       // the held token is a {
+  int closeAll;        // the held token is END_OF_FILE
+  int tooDeep;         // a level did not fit on the stack; the caller reports it
+} Layout;
+
+void initLayout(Layout *layout);
+
+/* A pull scanner: get_token() returns one token at a time from a file, a
+   pipe or a memory buffer. Only a window of the input is kept in memory;
+   it grows only when a single token is longer than the window. Nothing is
+   global, so several ScanEnvs can be used at the same time. */
+typedef struct scanEnv
+{
+  FILE *file;        // NULL when scanning a memory buffer
+  int closeFile;     // file was opened by scanOpenFile()
+  char *buf;         // buf[start .. end) is the input not scanned yet
+  size_t bufCap;
+  size_t start;
+  size_t end;
+  int ownsBuf;       // buf is the window, not the caller's buffer
+  int atEof;         // no more input beyond buf[end]
+  LexPos pos;
+  Token token;       // the token returned by the last get_token()
+  char *info;        // lexeme of that token
+  size_t infoCap;
+  Layout layout;
+  Token held;        // token waiting behind the INDENT/DEDENTs due before it
+  int holding;
+  char widthInfo[12]; // info of an INDENT
+  Diagnostic *diag;  // errors found so far
+  int diagCount;
+  int diagCapacity;
+} ScanEnv;
+
+ScanEnv *scanOpenFile(const char *filename);               // NULL if the file cannot be opened
+ScanEnv *scanOpenStream(FILE *file);                       // the caller closes file
+ScanEnv *scanOpenBuffer(const char *data, size_t len);     // data must outlive the ScanEnv
+Token *get_token(ScanEnv *env);                            // 下一个token；info 在下次调用前有效，ID 的 info 一直有效
+void scanClose(ScanEnv *env);
+void printScanDiagnostics(ScanEnv *env, FILE *out);
+
+#endif // SCANNER_H
@@ -13,25 +13,15 @@
 #include "symbol_table.h"
 Bool A_debugAnalyzer = FALSE;
 
-/* SHIFT is the power of two used as multiplier in hash function  */
-#define SHIFT 4
-
 /* hash()
-   [computation]: The hash function. It generates an integer according to the key, which is a string.
+   [computation]: The hash function. Names are interned, so the handle itself is the key.
  */
-static int hash(const char *key)
+static int hash(Symbol key)
 {
-	int temp = 0;
-	int i = 0;
-	while (key[i] != '\0')
-	{
-		temp = ((temp << SHIFT) + key[i]) % ST_SIZE;
-		++i;
-	}
-	return temp;
+	return (int)(key % ST_SIZE);
 }
 
-/* The "something" field in a tree node has the following meaning:
+/* The "something" of a tree node (see setNodeSomething()) has the following meaning:
   - for a declaration node, something is a pointer to the bucket-list-record in the symbol table. 声明节点的sth只想bucket-list-record
   - for a reference node (where a name is used), something is a pointer to the line-list-record int he symbol table. 引用节点的sth指向line-list-record
   - for other kind of nodes, the something field is meaningless and should not be used
@@ -72,10 +62,10 @@ void st_insert_dcl(TreeNode *dclNd, SymbolTable *st)
 	bk->prev = NULL;
 	bk->next = NULL;
 
-	int v = hash(dclNd->attr.dclAttr.name);
+	int v = hash(dclNd->name);
 	bk->next = st->hashTable[v]; // 头插法
 	st->hashTable[v] = bk;
-	dclNd->something = bk;
+	setNodeSomething(dclNd, bk);
 	bk->nd = dclNd;
 }
 
@@ -125,7 +115,7 @@ void st_insert_ref(TreeNode *refNd, struct BucketListRec *bk)
 		tempLineList->next = ll;
 	}
 
-	refNd->something = ll;
+	setNodeSomething(refNd, ll);
 	return;
 }
 
@@ -133,9 +123,9 @@ void st_insert_ref(TreeNode *refNd, struct BucketListRec *bk)
    st_lookup()
    [parameters]
    - st: the address of a symbol-table.
-   - name: a string.
+   - name: an interned name (see intern.h).
    [preconditions]:
-   - name should not be NULL.  name is the search key, the name of a variable, array, or function.
+   - name should not be NO_SYMBOL.  name is the search key, the name of a variable, array, or function.
    - st should not be NULL.   st is the starting point of searching. When the function is called st should the symbol table corresponding to the block where the name appears.
    [computation]:
    Find the bucket list record of the declaration associated with the name.  The search of the name starts from st. If the name is not found in st, then continue the search in the upper level table of st, ... until it is found or the top-most symbol table (for the global names) is reached used in the searching.
@@ -143,10 +133,10 @@ void st_insert_ref(TreeNode *refNd, struct BucketListRec *bk)
    -  returns NULL if the name not found.
    -  returns the bucket-list-record that corresponds to the declaration of the name.
  */
-struct BucketListRec *st_lookup(SymbolTable *st, const char *name)
+struct BucketListRec *st_lookup(SymbolTable *st, Symbol name)
 {
 	/* !!!!!!!!! Please put your code here !!!!!!!!!!!!! */
-	if (name == NULL || st == NULL)
+	if (name == NO_SYMBOL || st == NULL)
 	{
 		fprintf(stderr, "st_lookup(): invalid parameter\n");
 		return NULL;
@@ -157,7 +147,7 @@ struct BucketListRec *st_lookup(SymbolTable *st, const char *name)
 		BucketList tempBucketList = st->hashTable[v];
 		while (tempBucketList != NULL)
 		{
-			if (strcmp(tempBucketList->nd->attr.dclAttr.name, name) == 0)
+			if (tempBucketList->nd->name == name) /* same spelling, same handle */
 			{
 				return tempBucketList;
 			}
@@ -197,10 +187,10 @@ void st_print(SymbolTable *st)
 			LineList lines;
 			TreeNode *nd = bl->nd;
 			printf("%-6d", st->id);
-			/* both parameter and declaration store name in attr.dclAttr.name */
-			printf("%-15s", nd->attr.dclAttr.name);
+			/* both parameter and declaration store name in name */
+			printf("%-15s", symbolName(nd->name));
 			if (nd->nodeKind == DCL_ND) /* a declaration node */
-				switch (nd->kind.dcl)
+				switch (nd->kind)
 				{
 				case VAR_DCL:
 					printf("%-12s", "Var");
@@ -218,7 +208,7 @@ void st_print(SymbolTable *st)
 					break;
 				}
 			else if (nd->nodeKind == PARAM_ND)
-				switch (nd->kind.param)
+				switch (nd->kind)
 				{
 				case VAR_PARAM:
 					printf("%-12s", "Var_Param");
@@ -321,36 +311,41 @@ SymbolTable *st_attach(SymbolTable *st)
 
 static void LineList_free(LineList lis)
 {
-	if (lis == NULL)
-		return;
-	lis->nd->something = NULL; /*detach the line list record with the tree node */
-	LineList_free(lis->next);
-	free(lis);
+	while (lis != NULL)
+	{
+		LineList next = lis->next;
+		setNodeSomething(lis->nd, NULL); /*detach the line list record with the tree node */
+		free(lis);
+		lis = next;
+	}
 }
 
 static void BucketList_free(BucketList lis)
 {
-	if (lis == NULL)
-		return;
-	BucketList_free(lis->next);
-	lis->nd->something = NULL; /*detach the line list record with the tree node */
-	LineList_free(lis->lines);
-	free(lis);
+	while (lis != NULL)
+	{
+		BucketList next = lis->next;
+		setNodeSomething(lis->nd, NULL); /*detach the line list record with the tree node */
+		LineList_free(lis->lines);
+		free(lis);
+		lis = next;
+	}
 }
 
 /* stj_free()
  * release the space occupied by a symbol table
  */
 void st_free(SymbolTable *st)
-{ // 释放（递归回收）符号表 st 及其所有相关资源。
-	int j;
-	if (st == NULL)
-		return;
-	for (j = 0; j < ST_SIZE; j++)
+{ // 释放符号表 st、它后面的兄弟（next）及其所有相关资源。只在 lower 上递归：深度是块的嵌套层数
+	while (st != NULL)
 	{
-		BucketList_free(st->hashTable[j]);
+		SymbolTable *next = st->next;
+		for (int j = 0; j < ST_SIZE; j++)
+		{
+			BucketList_free(st->hashTable[j]);
+		}
+		st_free(st->lower);
+		free(st);
+		st = next;
 	}
-	st_free(st->lower);
-	st_free(st->next);
-	free(st);
 }
@@ -80,13 +80,13 @@ void st_insert_ref(TreeNode *refNd, struct BucketListRec *bk);
    [computation]:
    Find the bucket list record of the declaration associated with the name.  The search of the name starts from st. If the name is not found in st, then continue the search in the upper level table of st. It returns NULL if not found.
    [parameters]:
-   - name is the search key, the name of a variable, parameter, array, or function.
+   - name is the search key, the interned name of a variable, parameter, array, or function.
    - st is the starting point of searching. When the function is called st should the symbol table corresponding to the block where the node appears.
    [preconditions]:
    - st should not be NULL.
-   - name should not be NULL.
+   - name should not be NO_SYMBOL.
 */
-struct BucketListRec *st_lookup(SymbolTable *st, const char *name);
+struct BucketListRec *st_lookup(SymbolTable *st, Symbol name);
 
 /* st_print():
    [computation]:
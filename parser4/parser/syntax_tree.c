@@ -1,41 +1,59 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "parse.h"
 #include "scanner.h"
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    Bool stats = argc == 3 && strcmp(argv[1], "-s") == 0; // 统计模式：打印扫描的内存分配
+    if (argc != 2 && !stats)
     {
-        fprintf(stderr, "Usage: %s <source file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-s] <source file>\n", argv[0]);
         return 1;
     }
     // List *scanFile(const char *filename);
-    const char *filename = argv[1];
+    const char *filename = argv[argc - 1];
     // 1词法分析：获取 Token 链表（指针）
     List *tokenList = scanFile(filename);
-    if (!tokenList || tokenList->head == NULL)
+    if (!tokenList)
     {
+        fprintf(stderr, "Cannot open file %s\n", filename);
+        return 1;
+    }
+    if (tokenList->diagCount > 0)
+    {
+        printDiagnostics(tokenList, stderr);
         fprintf(stderr, "Lexical analysis failed.\n");
+        deleteList(tokenList);
+        internFree();
         return 1;
     }
     printf("Lexical analysis completed successfully.\n");
+    if (stats)
+        printListStats(tokenList);
 
     //  创建 Parser
     Parser *parser = createParser();
-    parser->set_token_list(parser, *tokenList); // 传递链表内容
+    parser->set_token_list(parser, tokenList); // 传递token表
 
     // 语法分析：生成语法树
     TreeNode *syntaxTree = parser->parse(parser);
-    if (!syntaxTree)
+    if (!syntaxTree || syntaxErrorCount(parser) > 0)
     {
         fprintf(stderr, "Parsing failed.\n");
+        parser->free_tree(parser, syntaxTree);
         destroyParser(parser);
-        freeList(tokenList);
-        free(tokenList);
+        deleteList(tokenList);
+        internFree();
         return 1;
     }
     printf("Parsing completed successfully.\n");
+    if (stats)
+    {
+        printParseStats(parser);
+        printTreeStats(syntaxTree);
+    }
 
     //  打印语法树
     printf("\n==== Syntax Tree ====\n");
@@ -44,8 +62,8 @@ int main(int argc, char *argv[])
     // 释放资源
     parser->free_tree(parser, syntaxTree);
     destroyParser(parser);
-    freeList(tokenList);
-    free(tokenList);
+    deleteList(tokenList);
+    internFree(); // 语法树中的名字都在标识符池里，最后释放
 
     printf("\nFinished.\n");
     return 0;
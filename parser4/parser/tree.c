@@ -0,0 +1,461 @@
+/****************************************************
+ File: tree.c
+
+ The syntax tree: pages of fixed size nodes linked by 32-bit ids, plus
+ the side tables for the fields few nodes have. A page starts with a
+ pointer back to its tree, so a node finds its tree from its own id:
+ node - (self % NODE_PAGE_SIZE) is slot 0 of its page. Every allocation
+ is from the tree's arena and the tables only grow; a rollback just
+ lowers the counts.
+ ****************************************************/
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "parse.h"
+
+#define TREE_BLOCK_SIZE (64 * 1024) // ordinary arena block of a syntax tree
+#define ROOT_NODE 1
+
+/* growTable()
+   A copy of the first used elements of table in a new block of capacity
+   elements from the tree's arena; the rest is zeroed. */
+static void *growTable(SyntaxTree *tree, void *table, size_t elemSize, size_t used, size_t capacity)
+{
+    void *bigger = arenaAlloc(&tree->arena, capacity * elemSize);
+    if (used > 0)
+        memcpy(bigger, table, used * elemSize);
+    memset((char *)bigger + used * elemSize, 0, (capacity - used) * elemSize);
+    return bigger;
+}
+
+static void initNode(TreeNode *node, NodeId self, NodeKind nodeKind)
+{
+    memset(node, 0, sizeof(TreeNode));
+    node->nodeKind = (unsigned char)nodeKind;
+    node->self = self;
+    node->type = VOID_TYPE; // 初始化表达式类型（用于类型检查）
+    node->name = NO_SYMBOL;
+}
+
+TreeNode *newNode(SyntaxTree *tree, NodeKind nodeKind)
+{
+    NodeId id = tree->nodeCount;
+    int p = (int)(id >> NODE_PAGE_BITS);
+    if (p == tree->pageCount)
+    {
+        if (tree->pageCount == tree->pageCapacity)
+        {
+            int capacity = tree->pageCapacity ? tree->pageCapacity * 2 : 16;
+            tree->page = (NodePage **)growTable(tree, tree->page, sizeof(NodePage *), tree->pageCount, capacity);
+            tree->pageCapacity = capacity;
+        }
+        NodePage *page = (NodePage *)arenaAlloc(&tree->arena, sizeof(NodePage));
+        page->tree = tree;
+        tree->page[tree->pageCount++] = page;
+    }
+    TreeNode *node = &tree->page[p]->node[id & (NODE_PAGE_SIZE - 1)];
+    tree->nodeCount++;
+    initNode(node, id, nodeKind);
+    return node;
+}
+
+/* newTree()
+   The header is the first allocation in the tree's own arena (see
+   freeTree()). Id 0 is taken up front so that no node gets NO_NODE. */
+SyntaxTree *newTree(void)
+{
+    Arena arena;
+    arenaInit(&arena, TREE_BLOCK_SIZE);
+    SyntaxTree *tree = (SyntaxTree *)arenaAlloc(&arena, sizeof(SyntaxTree));
+    memset(tree, 0, sizeof(SyntaxTree));
+    tree->arena = arena;
+    newNode(tree, ROOT); // NO_NODE
+    newNode(tree, ROOT); // ROOT_NODE
+    return tree;
+}
+
+TreeNode *treeRoot(SyntaxTree *tree)
+{
+    return nodeAt(tree, ROOT_NODE);
+}
+
+SyntaxTree *treeOf(const TreeNode *node)
+{
+    const TreeNode *first = node - (node->self & (NODE_PAGE_SIZE - 1));
+    const NodePage *page = (const NodePage *)((const char *)first - offsetof(NodePage, node));
+    return page->tree;
+}
+
+/* freeTree()
+   One arenaFree() for the nodes, the tables and the header. The arena is
+   copied out first, since the header is in a block it frees. */
+void freeTree(SyntaxTree *tree)
+{
+    if (tree == NULL)
+        return;
+    Arena arena = tree->arena;
+    arenaFree(&arena);
+}
+
+TreeNode *nodeAt(SyntaxTree *tree, NodeId id)
+{
+    if (id == NO_NODE)
+        return NULL;
+    return &tree->page[id >> NODE_PAGE_BITS]->node[id & (NODE_PAGE_SIZE - 1)];
+}
+
+TreeMark treeMark(SyntaxTree *tree)
+{
+    TreeMark mark;
+    mark.nodeCount = tree->nodeCount;
+    mark.constantCount = tree->constantCount;
+    mark.dclCount = tree->dclCount;
+    return mark;
+}
+
+void treeRollback(SyntaxTree *tree, TreeMark mark)
+{
+    tree->rolledBack += tree->nodeCount - mark.nodeCount;
+    tree->nodeCount = mark.nodeCount;
+    tree->constantCount = mark.constantCount;
+    tree->dclCount = mark.dclCount;
+}
+
+/* expandBody()
+   A lazy function body is parsed the first time its child slot is looked
+   at, see setLazyBodies(). */
+static void expandBody(const TreeNode *node)
+{
+    if (treeOf(node)->pendingBodies > 0 && node->nodeKind == DCL_ND && node->kind == FUN_DCL &&
+        node->child[1] == NO_NODE)
+        parseLazyBody((TreeNode *)node);
+}
+
+TreeNode *nodeChild(const TreeNode *node, int i)
+{
+    if (i == 1 && node->child[1] == NO_NODE)
+        expandBody(node);
+    return node->child[i] == NO_NODE ? NULL : nodeAt(treeOf(node), node->child[i]);
+}
+
+TreeNode *nodeSibling(const TreeNode *node)
+{
+    return node->rSibling == NO_NODE ? NULL : nodeAt(treeOf(node), node->rSibling);
+}
+
+TreeNode *nodePrevSibling(const TreeNode *node)
+{
+    return node->lSibling == NO_NODE ? NULL : nodeAt(treeOf(node), node->lSibling);
+}
+
+TreeNode *nodeParent(const TreeNode *node)
+{
+    return node->parent == NO_NODE ? NULL : nodeAt(treeOf(node), node->parent);
+}
+
+void setChild(TreeNode *node, int i, TreeNode *child)
+{
+    node->child[i] = child ? child->self : NO_NODE;
+    if (child)
+        child->parent = node->self;
+}
+
+void setSibling(TreeNode *node, TreeNode *next)
+{
+    node->rSibling = next ? next->self : NO_NODE;
+    if (next)
+        next->lSibling = node->self;
+}
+
+static NodeId movedId(NodeId id, NodeId delta)
+{
+    return id == NO_NODE ? NO_NODE : id + delta;
+}
+
+/* appendTree()
+   Copy every node of from but its ROOT to the end of tree, renumbering
+   the ids and the side table indexes, and return what was added to the
+   ids: node n of from is node n + delta of tree. The copies keep their
+   sibling chains; the caller links them in. A string CONST_EXPR keeps its
+   extra as it is. from is left as it was. */
+NodeId appendTree(SyntaxTree *tree, SyntaxTree *from)
+{
+    NodeId delta = tree->nodeCount - (ROOT_NODE + 1);
+    int constantBase = tree->constantCount;
+    int dclBase = tree->dclCount > 0 ? tree->dclCount - 1 : 0; // from's entry 1 goes to dclBase + 1
+
+    if (from->constantCount > 0)
+    {
+        int needed = constantBase + from->constantCount;
+        if (needed > tree->constantCapacity)
+        {
+            tree->constant = (Rational *)growTable(tree, tree->constant, sizeof(Rational), tree->constantCount, needed);
+            tree->constantCapacity = needed;
+        }
+        memcpy(tree->constant + constantBase, from->constant, from->constantCount * sizeof(Rational));
+        tree->constantCount = needed;
+    }
+    if (from->dclCount > 1)
+    {
+        int needed = dclBase + from->dclCount;
+        if (needed > tree->dclCapacity)
+        {
+            tree->dcl = (DclInfo *)growTable(tree, tree->dcl, sizeof(DclInfo), tree->dclCount, needed);
+            tree->dclCapacity = needed;
+        }
+        memcpy(tree->dcl + dclBase + 1, from->dcl + 1, (from->dclCount - 1) * sizeof(DclInfo));
+        tree->dclCount = needed;
+    }
+
+    for (NodeId id = ROOT_NODE + 1; id < from->nodeCount; id++)
+    {
+        TreeNode *node = newNode(tree, ROOT);
+        *node = *nodeAt(from, id);
+        node->self = id + delta;
+        node->parent = movedId(node->parent, delta);
+        node->lSibling = movedId(node->lSibling, delta);
+        node->rSibling = movedId(node->rSibling, delta);
+        for (int i = 0; i < MAX_CHILDREN; i++)
+            node->child[i] = movedId(node->child[i], delta);
+        if (node->nodeKind == EXPR_ND && node->kind == CONST_EXPR && node->type != STR_TYPE)
+            node->extra += (unsigned)constantBase;
+        else if (node->nodeKind == DCL_ND && node->extra != 0)
+            node->extra += (unsigned)dclBase;
+    }
+    tree->rolledBack += from->rolledBack;
+    tree->pendingBodies += from->pendingBodies;
+    if (from->bodyTokens != NULL)
+        tree->bodyTokens = from->bodyTokens;
+    return delta;
+}
+
+/* shiftLines()
+   Add delta to the line number of every node below id end that is on a
+   line after line. One sweep over the pages, in id order, with no tree
+   to walk: it moves the nodes behind an edit that added or removed
+   lines, whichever declaration they belong to. A node with no line
+   number (0) keeps it. */
+void shiftLines(SyntaxTree *tree, NodeId end, int line, int delta)
+{
+    for (int p = 0; p < tree->pageCount && ((NodeId)p << NODE_PAGE_BITS) < end; p++)
+    {
+        TreeNode *node = tree->page[p]->node;
+        NodeId last = end - ((NodeId)p << NODE_PAGE_BITS);
+        int count = last < NODE_PAGE_SIZE ? (int)last : NODE_PAGE_SIZE;
+        for (int i = 0; i < count; i++)
+        {
+            if (node[i].lineNum > line)
+                node[i].lineNum += delta;
+        }
+    }
+}
+
+Rational nodeConstant(const TreeNode *node)
+{
+    if (node->nodeKind != EXPR_ND || node->kind != CONST_EXPR || node->type == STR_TYPE)
+        return makeRational(0, 1);
+    return treeOf(node)->constant[node->extra];
+}
+
+void setConstant(TreeNode *node, Rational value)
+{
+    SyntaxTree *tree = treeOf(node);
+    if (tree->constantCount == tree->constantCapacity)
+    {
+        int capacity = tree->constantCapacity ? tree->constantCapacity * 2 : 64;
+        tree->constant = (Rational *)growTable(tree, tree->constant, sizeof(Rational), tree->constantCount, capacity);
+        tree->constantCapacity = capacity;
+    }
+    node->extra = (unsigned)tree->constantCount;
+    tree->constant[tree->constantCount++] = value;
+}
+
+/* dclInfo()
+   The side table entry of an array or function declaration, made on
+   first use. */
+static DclInfo *dclInfo(TreeNode *node)
+{
+    SyntaxTree *tree = treeOf(node);
+    if (node->extra == 0)
+    {
+        if (tree->dclCount == tree->dclCapacity)
+        {
+            int capacity = tree->dclCapacity ? tree->dclCapacity * 2 : 64;
+            tree->dcl = (DclInfo *)growTable(tree, tree->dcl, sizeof(DclInfo), tree->dclCount, capacity);
+            tree->dclCapacity = capacity;
+        }
+        if (tree->dclCount == 0)
+            tree->dclCount = 1; // entry 0 means "none yet"
+        node->extra = (unsigned)tree->dclCount++;
+        tree->dcl[node->extra].size = 0;
+        tree->dcl[node->extra].symbol = NULL;
+        tree->dcl[node->extra].bodyStart = 0;
+        tree->dcl[node->extra].bodyEnd = 0;
+    }
+    return &tree->dcl[node->extra];
+}
+
+int nodeArraySize(const TreeNode *node)
+{
+    if (node->nodeKind != DCL_ND || node->kind != ARRAY_DCL || node->extra == 0)
+        return 0;
+    return treeOf(node)->dcl[node->extra].size;
+}
+
+void setArraySize(TreeNode *node, int size)
+{
+    dclInfo(node)->size = size;
+}
+
+Bool nodeLazyBody(const TreeNode *node, int *start, int *end)
+{
+    if (node->nodeKind != DCL_ND || node->kind != FUN_DCL || node->extra == 0)
+        return FALSE;
+    const DclInfo *info = &treeOf(node)->dcl[node->extra];
+    if (info->bodyEnd == 0)
+        return FALSE;
+    *start = info->bodyStart;
+    *end = info->bodyEnd;
+    return TRUE;
+}
+
+void setLazyBody(TreeNode *node, int start, int end)
+{
+    SyntaxTree *tree = treeOf(node);
+    DclInfo *info = dclInfo(node);
+    tree->pendingBodies += (end != 0) - (info->bodyEnd != 0);
+    info->bodyStart = start;
+    info->bodyEnd = end;
+}
+
+SymbolTable *nodeScope(const TreeNode *node)
+{
+    if (node->nodeKind != DCL_ND || node->extra == 0)
+        return NULL;
+    return treeOf(node)->dcl[node->extra].symbol;
+}
+
+void setNodeScope(TreeNode *node, SymbolTable *scope)
+{
+    dclInfo(node)->symbol = scope;
+}
+
+void *nodeSomething(const TreeNode *node)
+{
+    SyntaxTree *tree = treeOf(node);
+    return node->self < tree->somethingCapacity ? tree->something[node->self] : NULL;
+}
+
+void setNodeSomething(TreeNode *node, void *something)
+{
+    SyntaxTree *tree = treeOf(node);
+    if (node->self >= tree->somethingCapacity)
+    {
+        NodeId capacity = tree->somethingCapacity ? tree->somethingCapacity : 256;
+        while (capacity <= node->self)
+            capacity *= 2;
+        tree->something = (void **)growTable(tree, tree->something, sizeof(void *), tree->somethingCapacity, capacity);
+        tree->somethingCapacity = capacity;
+    }
+    tree->something[node->self] = something;
+}
+
+/* One node on the stack of traverseTree(). A frame stands for a whole
+   sibling chain: when a node is done the frame moves on to its
+   rSibling, so the stack is only as deep as the nesting. */
+typedef struct visitFrame
+{
+    TreeNode *node;
+    void *context;      // of node and the siblings after it
+    void *childContext; // what pre() gave back for node
+    int next;           // next child of node to visit, -1 before pre()
+} VisitFrame;
+
+void traverseTree(TreeNode *tree, void *context, TreeVisitFn pre, TreeLeaveFn post, void *data)
+{
+    if (tree == NULL)
+        return;
+    int capacity = 64;
+    int top = 0;
+    VisitFrame *stack = (VisitFrame *)malloc(capacity * sizeof(VisitFrame));
+    if (stack == NULL)
+    {
+        handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to allocate the traversal stack.");
+        return;
+    }
+    stack[0].node = tree;
+    stack[0].context = context;
+    stack[0].next = -1;
+    while (top >= 0)
+    {
+        VisitFrame *frame = &stack[top];
+        if (frame->next < 0)
+        {
+            frame->childContext = pre ? pre(frame->node, frame->context, data) : frame->context;
+            frame->next = 0;
+            expandBody(frame->node);
+        }
+        while (frame->next < MAX_CHILDREN && frame->node->child[frame->next] == NO_NODE)
+            frame->next++;
+        if (frame->next < MAX_CHILDREN)
+        {
+            TreeNode *child = nodeChild(frame->node, frame->next++);
+            void *childContext = frame->childContext;
+            if (++top == capacity)
+            {
+                VisitFrame *bigger = (VisitFrame *)realloc(stack, 2 * capacity * sizeof(VisitFrame));
+                if (bigger == NULL)
+                {
+                    handleError(ERR_MEMORY_ALLOCATION_FAILED, "Failed to grow the traversal stack.");
+                    free(stack);
+                    return;
+                }
+                stack = bigger;
+                capacity *= 2;
+            }
+            stack[top].node = child;
+            stack[top].context = childContext;
+            stack[top].next = -1;
+            continue;
+        }
+        if (post)
+            post(frame->node, frame->context, data);
+        frame->node = nodeSibling(frame->node);
+        frame->next = -1;
+        if (frame->node == NULL)
+            top--;
+    }
+    free(stack);
+}
+
+static void *countNode(TreeNode *node, void *context, void *data)
+{
+    (void)node;
+    (*(long *)data)++;
+    return context;
+}
+
+/* printTreeStats()
+   The stats mode: how big the tree is, and how long one walk over it takes. */
+void printTreeStats(const TreeNode *root)
+{
+    SyntaxTree *tree = treeOf(root);
+    size_t nodes = tree->nodeCount;
+    size_t sideBytes = (size_t)tree->constantCount * sizeof(Rational) + (size_t)tree->dclCount * sizeof(DclInfo);
+    printf("Tree: %zu nodes of %zu bytes in %d pages, %d constants and %d declarations in side tables, %.1f bytes per node\n",
+           nodes, sizeof(TreeNode), tree->pageCount, tree->constantCount, tree->dclCount > 0 ? tree->dclCount - 1 : 0,
+           nodes ? (double)(nodes * sizeof(TreeNode) + sideBytes) / nodes : 0.0);
+    clock_t start = clock();
+    int rounds = 0;
+    long visited = 0;
+    do
+    {
+        visited = 0;
+        traverseTree((TreeNode *)root, NULL, countNode, NULL, &visited);
+        rounds++;
+    } while (clock() - start < CLOCKS_PER_SEC / 10);
+    double ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / rounds;
+    printf("Tree walk: %ld nodes, %.1f ns per node\n", visited, visited ? ns / visited : 0.0);
+    arenaPrintStats(&tree->arena, "Tree arena");
+}